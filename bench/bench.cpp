@@ -0,0 +1,429 @@
+// Microbenchmarks over fixed synthetic corpora. Prints one JSON document:
+//   bench [--min-time-ms N] [--urls N] [--out file.json] [name-filter...]
+// Every case is timed over repeated runs until min-time has passed; allocations are
+// counted at the malloc level (Linux, see below) and reported per op.
+
+#include "dbmanager.h"
+#include "filewriter.h"
+#include "jobstore.h"
+#include "linkfilter.h"
+#include "urlhelpers.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+static std::atomic<qint64> allocCount{0};
+static std::atomic<qint64> allocBytes{0};
+
+#if defined(__linux__)
+#include <dlfcn.h>
+
+// QString, the Qt containers and SQLite allocate with malloc/realloc, not operator new,
+// so the counters sit on malloc itself: the executable's definitions interpose the libc
+// ones for every library, and operator new ends up here too. realloc counts as one
+// allocation of the new size (it may move the block).
+static const bool allocsCounted = true;
+
+namespace {
+
+using MallocFn  = void* (*)(std::size_t);
+using CallocFn  = void* (*)(std::size_t, std::size_t);
+using ReallocFn = void* (*)(void*, std::size_t);
+using FreeFn    = void (*)(void*);
+
+MallocFn  realMalloc  = nullptr;
+CallocFn  realCalloc  = nullptr;
+ReallocFn realRealloc = nullptr;
+FreeFn    realFree    = nullptr;
+bool resolving = false;
+
+// dlsym may allocate while the real functions are being looked up: served from here, never freed
+alignas(std::max_align_t) char bootstrap[4096];
+std::size_t bootstrapUsed = 0;
+
+bool fromBootstrap(const void* p)
+{
+    return p >= static_cast<const void*>(bootstrap)
+           && p < static_cast<const void*>(bootstrap + sizeof bootstrap);
+}
+
+void* bootstrapAlloc(std::size_t size)
+{
+    const std::size_t a = alignof(std::max_align_t);
+    size = (size + a - 1) / a * a;
+    if (bootstrapUsed + size > sizeof bootstrap)
+        return nullptr;
+    void* p = bootstrap + bootstrapUsed;
+    bootstrapUsed += size;
+    return p;   // static storage: already zeroed for calloc
+}
+
+bool resolve()
+{
+    if (realFree)
+        return true;
+    if (resolving)
+        return false;
+
+    resolving = true;
+    realMalloc  = reinterpret_cast<MallocFn>(dlsym(RTLD_NEXT, "malloc"));
+    realCalloc  = reinterpret_cast<CallocFn>(dlsym(RTLD_NEXT, "calloc"));
+    realRealloc = reinterpret_cast<ReallocFn>(dlsym(RTLD_NEXT, "realloc"));
+    realFree    = reinterpret_cast<FreeFn>(dlsym(RTLD_NEXT, "free"));
+    resolving = false;
+    return realFree != nullptr;
+}
+
+void countAlloc(std::size_t size)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(qint64(size), std::memory_order_relaxed);
+}
+
+} // namespace
+
+extern "C" {
+
+void* malloc(std::size_t size)
+{
+    if (!resolve())
+        return bootstrapAlloc(size);
+    countAlloc(size);
+    return realMalloc(size);
+}
+
+void* calloc(std::size_t n, std::size_t size)
+{
+    if (!resolve())
+        return bootstrapAlloc(n * size);
+    countAlloc(n * size);
+    return realCalloc(n, size);
+}
+
+void* realloc(void* p, std::size_t size)
+{
+    if (fromBootstrap(p)) {
+        // old size unknown: copy what can be there, bounded by the end of the buffer
+        void* q = malloc(size);
+        const std::size_t avail = bootstrap + sizeof bootstrap - static_cast<char*>(p);
+        if (q)
+            std::memcpy(q, p, std::min(size, avail));
+        return q;
+    }
+    if (!resolve())
+        return bootstrapAlloc(size);
+    countAlloc(size);
+    return realRealloc(p, size);
+}
+
+void free(void* p)
+{
+    if (!p || fromBootstrap(p) || !resolve())
+        return;
+    realFree(p);
+}
+
+} // extern "C"
+#else
+// no interposition here: allocations are left out of the report rather than undercounted
+static const bool allocsCounted = false;
+#endif
+
+namespace {
+
+struct Options {
+    qint64 minTimeMs = 500;
+    int urls = 1000000;
+    QStringList filters;
+};
+
+// items: what one op processes (URLs, rows, bytes...), for the throughput figure
+struct Case {
+    QString name;
+    qint64 items = 1;
+    QString unit = "ops";
+    std::function<void()> setup;   // untimed, before every op
+    std::function<void()> op;
+};
+
+QJsonObject measure(const Case& c, const Options& opt)
+{
+    if (c.setup) c.setup();
+    c.op();   // warm-up: first-touch allocations, regex JIT, SQLite page cache
+
+    qint64 ops = 0, elapsedNs = 0, allocs = 0, bytes = 0;
+    while (elapsedNs < opt.minTimeMs * 1000000 || ops < 3) {
+        if (c.setup) c.setup();
+
+        const qint64 a0 = allocCount.load(), b0 = allocBytes.load();
+        QElapsedTimer t;
+        t.start();
+        c.op();
+        elapsedNs += t.nsecsElapsed();
+        allocs += allocCount.load() - a0;
+        bytes += allocBytes.load() - b0;
+        ++ops;
+    }
+
+    const double nsPerOp = double(elapsedNs) / ops;
+    QJsonObject r;
+    r["name"] = c.name;
+    r["iterations"] = ops;
+    r["ns_per_op"] = nsPerOp;
+    if (allocsCounted) {
+        r["allocs_per_op"] = double(allocs) / ops;
+        r["alloc_bytes_per_op"] = double(bytes) / ops;
+    }
+    r["items_per_op"] = c.items;
+    r["throughput"] = c.items * 1e9 / nsPerOp;
+    r["throughput_unit"] = c.unit + "/s";
+    return r;
+}
+
+// ---- corpora: fixed seed, so every run and every machine sees the same input ----
+
+QStringList makeUrls(int n)
+{
+    static const char* const hosts[] = { "example.com", "cdn.example.com", "files.example.org",
+                                         "mirror.example.net", "static.example.com" };
+    static const char* const exts[] = { ".pdf", ".zip", ".html", ".tar.gz", ".jpg", "", ".iso", ".txt" };
+
+    QRandomGenerator rng(42);
+    QStringList out;
+    out.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        out << QString("https://%1/dir%2/sub%3/file_%4%5")
+                   .arg(hosts[rng.bounded(5)])
+                   .arg(rng.bounded(100))
+                   .arg(rng.bounded(1000))
+                   .arg(i)
+                   .arg(exts[rng.bounded(8)]);
+    }
+    return out;
+}
+
+QString makeHtml(int links)
+{
+    QRandomGenerator rng(7);
+    QString html;
+    html.reserve(links * 160);
+    html += "<!doctype html><html><head><title>index</title>"
+            "<link rel=\"stylesheet\" href=\"/style.css\"></head><body>\n";
+    for (int i = 0; i < links; ++i) {
+        switch (rng.bounded(4)) {
+        case 0: html += QString("<p>Item %1 <a href=\"/files/doc_%1.pdf\">doc</a></p>\n").arg(i); break;
+        case 1: html += QString("<img src='https://cdn.example.com/img/%1.jpg' alt=\"x\">\n").arg(i); break;
+        case 2: html += QString("<a class=\"nav\" HREF=\"../up/%1/\">up</a> <a href=\"#top\">top</a>\n").arg(i % 500); break;
+        default: html += QString("<div><span>%1</span><a href=\"mailto:a%1@example.com\">mail</a></div>\n").arg(i); break;
+        }
+    }
+    html += "</body></html>\n";
+    return html;
+}
+
+bool selected(const Options& opt, const QString& name)
+{
+    if (opt.filters.isEmpty()) return true;
+    for (const QString& f : opt.filters)
+        if (name.contains(f)) return true;
+    return false;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"min-time-ms", "Minimum timed duration per case.", "ms", "500"});
+    parser.addOption({"urls", "Size of the URL-list corpus.", "n", "1000000"});
+    parser.addOption({"out", "Write the JSON here instead of stdout.", "file"});
+    parser.addPositionalArgument("filter", "Run only cases whose name contains one of these.", "[filter...]");
+    parser.process(app);
+
+    Options opt;
+    opt.minTimeMs = qMax<qint64>(1, parser.value("min-time-ms").toLongLong());
+    opt.urls = qMax(1, parser.value("urls").toInt());
+    opt.filters = parser.positionalArguments();
+
+    QTemporaryDir tmp;
+    if (!tmp.isValid()) {
+        qCritical() << "cannot create a temporary directory";
+        return 1;
+    }
+
+    const QStringList urlStrings = makeUrls(opt.urls);
+    QList<QUrl> urls;
+    urls.reserve(urlStrings.size());
+    for (const QString& s : urlStrings)
+        urls << QUrl(s);
+
+    const QString html = makeHtml(20000);
+    const QUrl pageBase("https://example.com/index/");
+
+    QVector<Case> cases;
+
+    // ---- page scraping and link filtering ----
+
+    cases.push_back({ "html.extractLinks/20k", 20000, "links", {}, [&]() {
+        volatile int n = UrlHelpers::extractLinksFromHtml(html, pageBase).size();
+        (void)n;
+    } });
+
+    cases.push_back({ "url.fileNameFromUrl/list", urlStrings.size(), "urls", {}, [&]() {
+        qint64 total = 0;
+        for (const QString& s : urlStrings)
+            total += UrlHelpers::fileNameFromUrl(s).size();
+        volatile qint64 sink = total;
+        (void)sink;
+    } });
+
+    LinkFilter defaultFilter;
+    const QUrl listBase("https://example.com/");
+    cases.push_back({ "filter.accepts/list", urls.size(), "urls", {}, [&]() {
+        int passed = 0;
+        for (const QUrl& u : std::as_const(urls))
+            passed += defaultFilter.accepts(u, listBase);
+        volatile int sink = passed;
+        (void)sink;
+    } });
+
+    FilterRules rules = FilterRules::defaults();
+    rules.include = QStringList{ "*/dir1*/*", "re:file_\\d+7\\.", "*.iso" };
+    rules.exclude = QStringList{ "*/sub99*", "*.txt" };
+    rules.sameHostOnly = false;
+    rules.denyHosts = QStringList{ "mirror.example.net" };
+    LinkFilter patternFilter;
+    patternFilter.compile(rules);
+    cases.push_back({ "filter.evaluate/list+patterns", urls.size(), "urls", {}, [&]() {
+        volatile int n = patternFilter.evaluate(urls, listBase).size();
+        (void)n;
+    } });
+
+    // ---- job store: the whole URL list added, then looked up again ----
+
+    cases.push_back({ "jobstore.add/list", urlStrings.size(), "jobs", {}, [&]() {
+        JobStore store;
+        for (const QString& s : urlStrings)
+            store.add(s, "/downloads/" + UrlHelpers::fileNameFromUrl(s));
+        volatile int n = store.size();
+        (void)n;
+    } });
+
+    JobStore filled;
+    for (const QString& s : urlStrings)
+        filled.add(s, "/downloads/" + UrlHelpers::fileNameFromUrl(s));
+    cases.push_back({ "jobstore.find/list", urlStrings.size(), "lookups", {}, [&]() {
+        qint64 sum = 0;
+        for (const QString& s : urlStrings)
+            sum += filled.find(s);
+        volatile qint64 sink = sum;
+        (void)sink;
+    } });
+
+    // ---- DB: a temporary SQLite file pre-filled with 10k jobs ----
+
+    DBManager db;
+    const int dbRows = 10000;
+    if (!db.openAtPath(tmp.filePath("bench.db"))) {
+        qCritical() << "cannot open the benchmark database";
+        return 1;
+    }
+    db.beginBatch();
+    for (int i = 0; i < dbRows; ++i)
+        db.addOrIgnoreQueued(urlStrings[i % urlStrings.size()], "/tmp/bench/" + QString::number(i),
+                             QString::number(i));
+    db.commitBatch();
+
+    QRandomGenerator dbRng(3);
+    cases.push_back({ "db.updateProgress", 1, "rows", {}, [&]() {
+        const int i = int(dbRng.bounded(dbRows));
+        db.updateProgress(urlStrings[i % urlStrings.size()], "/tmp/bench/" + QString::number(i), i % 100);
+    } });
+
+    cases.push_back({ "db.updateStatus", 1, "rows", {}, [&]() {
+        const int i = int(dbRng.bounded(dbRows));
+        db.updateStatus(urlStrings[i % urlStrings.size()], "/tmp/bench/" + QString::number(i), "Downloading");
+    } });
+
+    QVector<ProgressUpdate> batch;
+    cases.push_back({ "db.updateProgressBatch/1000", 1000, "rows", [&]() {
+        batch.clear();
+        for (int k = 0; k < 1000; ++k) {
+            const int i = int(dbRng.bounded(dbRows));
+            batch.push_back({ urlStrings[i % urlStrings.size()], "/tmp/bench/" + QString::number(i), k % 100 });
+        }
+    }, [&]() { db.updateProgressBatch(batch); } });
+
+    cases.push_back({ "db.fetchRecent/200", 200, "rows", {}, [&]() {
+        volatile int n = db.fetchRecent(200).size();
+        (void)n;
+    } });
+
+    const QString since = QDateTime::currentDateTimeUtc().addSecs(-3600).toString(Qt::ISODate);
+    cases.push_back({ "db.fetchUpdatedSince/200", 200, "rows", {}, [&]() {
+        volatile int n = db.fetchUpdatedSince(since, 200).size();
+        (void)n;
+    } });
+
+    // ---- writer: 64 MiB in network-sized chunks, called directly (no thread hop) ----
+
+    const QByteArray chunk(64 * 1024, 'x');
+    const int chunksPerOp = 1024;
+    FileWriterWorker writer;
+    const QString outPath = tmp.filePath("append.bin");
+    cases.push_back({ "writer.appendChunk/64MiB", qint64(chunk.size()) * chunksPerOp, "bytes",
+                      [&]() { writer.openFile(0, outPath); },
+                      [&]() {
+        for (int i = 0; i < chunksPerOp; ++i)
+            writer.appendChunk(0, chunk);
+        writer.closeFile(0);
+    } });
+
+    QJsonArray results;
+    for (const Case& c : std::as_const(cases)) {
+        if (!selected(opt, c.name)) continue;
+        results.append(measure(c, opt));
+        QTextStream(stderr) << c.name << '\n';
+    }
+
+    QJsonObject doc;
+    doc["suite"] = "multi_downloader";
+    doc["qt"] = QString(qVersion());
+    doc["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    doc["min_time_ms"] = opt.minTimeMs;
+    doc["url_corpus"] = opt.urls;
+    doc["results"] = results;
+
+    const QByteArray json = QJsonDocument(doc).toJson();
+    const QString out = parser.value("out");
+    if (out.isEmpty()) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+
+    QFile f(out);
+    if (!f.open(QIODevice::WriteOnly) || f.write(json) != json.size()) {
+        qCritical().noquote() << "cannot write" << out;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+# Microbenchmarks for the hot helper paths; `make bench` in the main build runs them.
+
+QT       += core network sql
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = bench
+
+# malloc-level allocation counters look the libc functions up with dlsym
+linux: LIBS += -ldl
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    bench.cpp \
+    ../dbmanager.cpp \
+    ../filewriter.cpp \
+    ../jobstore.cpp \
+    ../linkfilter.cpp \
+    ../packfile.cpp \
+    ../tracer.cpp \
+    ../urlhelpers.cpp
+
+HEADERS += \
+    ../dbmanager.h \
+    ../filewriter.h \
+    ../jobstore.h \
+    ../linkfilter.h \
+    ../packfile.h \
+    ../tracer.h \
+    ../urlhelpers.h
@@ -0,0 +1,201 @@
+#include "blockreader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+static const qint64 ROTATIONAL_BLOCK = 8 * 1024 * 1024;   // fewer, longer sequential requests
+static const qint64 SOLID_STATE_BLOCK = 1024 * 1024;      // stays in L2/L3 while hashed
+static const qint64 DEFAULT_BLOCK = 2 * 1024 * 1024;
+
+BlockReader::~BlockReader()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            quit = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    for (char* b : buffers)
+        delete[] b;
+}
+
+qint64 BlockReader::blockSizeFor(const QString& path)
+{
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0)
+        return DEFAULT_BLOCK;
+
+    static QMutex lock;
+    static QHash<quint64, qint64> known;   // st_dev -> block size
+
+    QMutexLocker locker(&lock);
+    const auto it = known.constFind(quint64(st.st_dev));
+    if (it != known.constEnd())
+        return it.value();
+
+    // whole disks have queue/ themselves, partitions inherit it from their parent
+    const QString dev = QFileInfo(QString("/sys/dev/block/%1:%2")
+                                      .arg(major(st.st_dev)).arg(minor(st.st_dev))).canonicalFilePath();
+    qint64 block = DEFAULT_BLOCK;
+    if (!dev.isEmpty()) {
+        QFile rot(dev + "/queue/rotational");
+        if (!rot.exists())
+            rot.setFileName(QFileInfo(dev).dir().filePath("queue/rotational"));
+        if (rot.open(QIODevice::ReadOnly))
+            block = rot.readAll().trimmed() == "1" ? ROTATIONAL_BLOCK : SOLID_STATE_BLOCK;
+    }
+
+    known.insert(quint64(st.st_dev), block);
+    return block;
+#else
+    Q_UNUSED(path);
+    return DEFAULT_BLOCK;
+#endif
+}
+
+bool BlockReader::read(const QString& path, const Sink& sink, qint64 offset, qint64 length)
+{
+    error.clear();
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        error = f.errorString();
+        return false;
+    }
+
+    const qint64 size = f.size();
+    if (offset < 0 || offset > size) {
+        error = "Offset beyond end of file";
+        return false;
+    }
+    if (length < 0 || offset + length > size)
+        length = size - offset;
+    if (length == 0)
+        return true;
+
+    return readBuffered(f, offset, length, blockSizeFor(path), sink);
+}
+
+void BlockReader::reserve(qint64 block)
+{
+    if (capacity >= block)
+        return;
+
+    for (char*& b : buffers) {
+        delete[] b;
+        b = new char[size_t(block)];
+    }
+    capacity = block;
+}
+
+// filled[i] markers besides a byte count
+static const qint64 EMPTY = -1;
+static const qint64 FAILED = -2;
+
+void BlockReader::readAhead()
+{
+    std::unique_lock<std::mutex> lk(m);
+    while (true) {
+        cv.wait(lk, [&]() { return quit || (job && filled[next] == EMPTY); });
+        if (quit)
+            return;
+
+        const int i = next;
+        const qint64 want = qMin(jobBlock, jobLeft);
+        QFile* f = job;
+        busy = true;
+        lk.unlock();
+
+        qint64 got = want > 0 ? f->read(buffers[i], want) : 0;
+        if (got != want)
+            got = FAILED;   // error, or the file shrank underneath us
+
+        lk.lock();
+        busy = false;
+        if (job == f) {   // still wanted: the caller may have given up meanwhile
+            filled[i] = got;
+            next ^= 1;
+            if (got <= 0)
+                job = nullptr;
+            else
+                jobLeft -= got;
+        }
+        cv.notify_all();
+    }
+}
+
+bool BlockReader::readBuffered(QFile& f, qint64 offset, qint64 length, qint64 block, const Sink& sink)
+{
+    if (!f.seek(offset)) {
+        error = f.errorString();
+        return false;
+    }
+    reserve(qMin(block, length));
+
+    // a single block gains nothing from reading ahead
+    if (length <= block) {
+        if (f.read(buffers[0], length) != length) {
+            error = "Read error";
+            return false;
+        }
+        sink(buffers[0], length);
+        return true;
+    }
+
+    if (!thread.joinable())
+        thread = std::thread(&BlockReader::readAhead, this);
+
+    {
+        std::lock_guard<std::mutex> lk(m);
+        job = &f;
+        jobLeft = length;
+        jobBlock = block;
+        filled[0] = filled[1] = EMPTY;
+        next = 0;
+    }
+    cv.notify_all();
+
+    bool ok = true;
+    for (int i = 0; ; i ^= 1) {
+        qint64 n;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            cv.wait(lk, [&]() { return filled[i] != EMPTY; });
+            n = filled[i];
+        }
+        if (n == FAILED) {
+            ok = false;
+            error = "Read error";
+            break;
+        }
+        if (n == 0)
+            break;
+
+        sink(buffers[i], n);
+
+        {
+            std::lock_guard<std::mutex> lk(m);
+            filled[i] = EMPTY;
+        }
+        cv.notify_all();
+    }
+
+    // f goes out of scope with this call: the thread must be done with it
+    std::unique_lock<std::mutex> lk(m);
+    job = nullptr;
+    cv.wait(lk, [&]() { return !busy; });
+    return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef BLOCKREADER_H
+#define BLOCKREADER_H
+
+
+#include <QString>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class QFile;
+
+// Sequential block source for hashing: the next block is already on its way in while
+// the caller works on the current one. A helper thread reads ahead into two buffers.
+// One instance keeps its buffers and its read-ahead thread across calls and files.
+class BlockReader {
+public:
+    using Sink = std::function<void(const char* data, qint64 len)>;
+
+    BlockReader() = default;
+    ~BlockReader();
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Feeds [offset, offset + length) to sink block by block; length < 0 reads to the end.
+    bool read(const QString& path, const Sink& sink, qint64 offset = 0, qint64 length = -1);
+    QString errorString() const { return error; }
+
+    // Long blocks for spinning disks, cache-sized ones for SSD/NVMe (Linux sysfs; cached per device).
+    static qint64 blockSizeFor(const QString& path);
+
+private:
+    bool readBuffered(QFile& f, qint64 offset, qint64 length, qint64 block, const Sink& sink);
+    void readAhead();   // body of the read-ahead thread
+    void reserve(qint64 block);
+
+    char* buffers[2] = { nullptr, nullptr };
+    qint64 capacity = 0;
+    QString error;
+
+    // Handshake with the read-ahead thread, all under m. filled[i]: EMPTY while the
+    // thread may fill buffer i, otherwise its byte count (0 at the end, FAILED).
+    std::thread thread;
+    std::mutex m;
+    std::condition_variable cv;
+    QFile* job = nullptr;    // file being read; null while idle
+    qint64 jobLeft = 0;
+    qint64 jobBlock = 0;
+    qint64 filled[2] = { -1, -1 };
+    int next = 0;            // buffer the thread fills next
+    bool busy = false;       // thread inside QFile::read
+    bool quit = false;
+};
+
+#endif
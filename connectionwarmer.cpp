@@ -0,0 +1,135 @@
+#include "connectionwarmer.h"
+#include "tracer.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QHostInfo>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QStringList>
+#include <QSslConfiguration>
+
+static QSslConfiguration tunedSslConfiguration()
+{
+    QSslConfiguration conf = QSslConfiguration::defaultConfiguration();
+    conf.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2,
+                                   QSslConfiguration::ALPNProtocolHTTP1_1 });
+    conf.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    conf.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    conf.setSslOption(QSsl::SslOptionDisableSessionSharing, false);
+    return conf;
+}
+
+ConnectionWarmer::ConnectionWarmer(QNetworkAccessManager* net, QObject* parent)
+    : QObject(parent)
+    , net(net)
+{
+}
+
+void ConnectionWarmer::prewarm(const QList<QUrl>& urls)
+{
+    int started = 0;
+    for (const QUrl& u : urls) {
+        if (started >= maxHosts) break;
+
+        const QString host = u.host();
+        const bool tls = u.scheme() == "https";
+        if (host.isEmpty() || (!tls && u.scheme() != "http")) continue;
+
+        const quint16 port = quint16(u.port(tls ? 443 : 80));
+        const QString key = u.scheme() + "://" + host + ":" + QString::number(port);
+        if (warmed.contains(key)) continue;
+        warmed.insert(key);
+        started++;
+
+        // Resolve first (fills Qt's host cache and gives us the DNS time), then open the
+        // connection; requests queued for this host will ride on it.
+        QElapsedTimer timer;
+        timer.start();
+        const qint64 traceStart = Trace::nowUs();
+        QHostInfo::lookupHost(host, this, [this, host, port, tls, timer, traceStart](const QHostInfo& info) {
+            stats[host].dnsMs = timer.elapsed();
+            Trace::complete("net", "dns", traceStart, Trace::nowUs() - traceStart);
+            if (info.error() != QHostInfo::NoError) return;
+
+            if (tls)
+                net->connectToHostEncrypted(host, port, tunedSslConfiguration());
+            else
+                net->connectToHost(host, port);
+        });
+    }
+}
+
+void ConnectionWarmer::prepare(QNetworkRequest& req) const
+{
+    req.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+
+    if (req.url().scheme() != "https") return;
+
+    QSslConfiguration conf = tunedSslConfiguration();
+    auto ticket = sessionTickets.constFind(req.url().host());
+    if (ticket != sessionTickets.constEnd())
+        conf.setSessionTicket(ticket.value());
+    req.setSslConfiguration(conf);
+}
+
+void ConnectionWarmer::track(QNetworkReply* reply)
+{
+    const QString host = reply->request().url().host();
+    const qint64 startedMs = QDateTime::currentMSecsSinceEpoch();
+
+    stats[host].requests++;
+
+    // encrypted() only fires when this request had to wait for a fresh TLS handshake
+    connect(reply, &QNetworkReply::encrypted, this, [this, reply, host, startedMs]() {
+        HostStats& s = stats[host];
+        s.handshakes++;
+        s.handshakeMs += QDateTime::currentMSecsSinceEpoch() - startedMs;
+
+        const QByteArray ticket = reply->sslConfiguration().sessionTicket();
+        if (!ticket.isEmpty())
+            sessionTickets[host] = ticket;
+    });
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply, host]() {
+        if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool())
+            stats[host].http2++;
+    });
+}
+
+bool ConnectionWarmer::usesHttp2(const QString& host) const
+{
+    auto it = stats.constFind(host);
+    return it != stats.constEnd() && it->http2 > 0;
+}
+
+QString ConnectionWarmer::report() const
+{
+    QStringList parts;
+    for (auto it = stats.cbegin(); it != stats.cend(); ++it) {
+        const HostStats& s = it.value();
+        if (s.requests == 0) continue;
+
+        QString line = QString("%1: %2 req, %3 reused")
+                           .arg(it.key())
+                           .arg(s.requests)
+                           .arg(qMax(0, s.requests - s.handshakes));
+        if (s.handshakes > 0)
+            line += QString(", %1 TLS handshake(s) avg %2 ms")
+                        .arg(s.handshakes)
+                        .arg(s.handshakeMs / s.handshakes);
+        if (s.http2 > 0)
+            line += QString(", %1 over HTTP/2").arg(s.http2);
+        if (s.dnsMs >= 0)
+            line += QString(", DNS %1 ms").arg(s.dnsMs);
+        parts << line;
+    }
+    return parts.join("; ");
+}
+
+void ConnectionWarmer::resetStats()
+{
+    stats.clear();
+    warmed.clear();
+}
@@ -0,0 +1,48 @@
+#ifndef CONNECTIONWARMER_H
+#define CONNECTIONWARMER_H
+
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QUrl>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
+
+// Cuts per-request connection cost: resolves and connects to queued hosts ahead of
+// time, lets requests negotiate HTTP/2, and carries TLS session tickets over to new
+// connections. Also counts handshakes vs reused connections per host.
+class ConnectionWarmer : public QObject {
+    Q_OBJECT
+public:
+    explicit ConnectionWarmer(QNetworkAccessManager* net, QObject* parent = nullptr);
+
+    int maxHosts = 16;   // distinct hosts pre-connected per batch
+
+    void prewarm(const QList<QUrl>& urls);
+    void prepare(QNetworkRequest& req) const;
+    void track(QNetworkReply* reply);
+
+    bool usesHttp2(const QString& host) const;
+    QString report() const;
+    void resetStats();
+
+private:
+    struct HostStats {
+        int requests = 0;
+        int handshakes = 0;
+        qint64 handshakeMs = 0;
+        int http2 = 0;
+        qint64 dnsMs = -1;
+    };
+
+    QNetworkAccessManager* net;
+    QHash<QString, QByteArray> sessionTickets;   // host -> last TLS session ticket
+    QHash<QString, HostStats> stats;
+    QSet<QString> warmed;                        // "scheme://host:port" already pre-connected
+};
+
+#endif
@@ -1,10 +1,15 @@
 #include "dbmanager.h"
+#include "tracer.h"
 
 #include <QSqlQuery>
 #include <QVariant>
 #include <QStandardPaths>
 #include <QDir>
 #include <QDateTime>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 static QString defaultDbPath()
 {
@@ -18,6 +23,21 @@ static QString nowIso()
     return QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
 }
 
+static qint64 nowSecs()
+{
+    return QDateTime::currentSecsSinceEpoch();
+}
+
+// Extra condition for writes on behalf of a lease holder (empty owner: unconditional)
+static QString leaseGuard(const QString& owner)
+{
+    return owner.isEmpty() ? QString() : QString(" AND lease_owner=?");
+}
+
+static const char* const CLAIMABLE =
+    "shared=1 AND lease_expires < ? "
+    "AND status NOT LIKE 'Done%' AND status NOT LIKE 'Error%' AND status NOT LIKE 'Skipped%'";
+
 DBManager::DBManager()
 {
     connName = QString("scraper_conn_%1").arg(reinterpret_cast<quintptr>(this));
@@ -28,23 +48,24 @@ DBManager::~DBManager()
     close();
 }
 
-bool DBManager::openDefault()
+bool DBManager::openDefault(bool rollbackJournal)
 {
-    return openAtPath(defaultDbPath());
+    return openAtPath(defaultDbPath(), rollbackJournal);
 }
 
-bool DBManager::openAtPath(const QString& dbPath)
+bool DBManager::openAtPath(const QString& dbPath, bool rollbackJournal)
 {
     if (db.isValid() && db.isOpen())
         return true;
 
     db = QSqlDatabase::addDatabase("QSQLITE", connName);
     db.setDatabaseName(dbPath);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");   // other instances may hold the write lock
 
     if (!db.open())
         return false;
 
-    return ensureSchema();
+    return ensureSchema(rollbackJournal);
 }
 
 void DBManager::close()
@@ -56,12 +77,21 @@ void DBManager::close()
     }
 }
 
-bool DBManager::ensureSchema()
+bool DBManager::ensureSchema(bool rollbackJournal)
 {
     QSqlQuery q(db);
 
-    q.exec("PRAGMA journal_mode=WAL;");
+    // only takes effect on a new file (compact() converts older ones)
+    q.exec("PRAGMA auto_vacuum=INCREMENTAL;");
+
+    // the pragma answers with the mode in effect: a file another process holds in WAL stays WAL
+    const QString journal = rollbackJournal ? "delete" : "wal";
+    if (!q.exec("PRAGMA journal_mode=" + journal + ";") || !q.next()
+        || q.value(0).toString().compare(journal, Qt::CaseInsensitive) != 0)
+        return false;
+
     q.exec("PRAGMA synchronous=NORMAL;");
+    q.exec("PRAGMA busy_timeout=5000;");
 
     const char* sql =
         "CREATE TABLE IF NOT EXISTS downloads ("
@@ -77,11 +107,125 @@ bool DBManager::ensureSchema()
         "  UNIQUE(url, file_path)"
         ");";
 
-    return q.exec(sql);
+    const char* mirrorsSql =
+        "CREATE TABLE IF NOT EXISTS download_mirrors ("
+        "  url TEXT NOT NULL,"
+        "  mirror_url TEXT NOT NULL,"
+        "  position INTEGER NOT NULL DEFAULT 0,"
+        "  UNIQUE(url, mirror_url)"
+        ");";
+
+    const char* packSql =
+        "CREATE TABLE IF NOT EXISTS pack_index ("
+        "  url TEXT NOT NULL,"
+        "  file_path TEXT NOT NULL,"
+        "  pack_path TEXT NOT NULL,"
+        "  data_offset INTEGER NOT NULL,"
+        "  size INTEGER NOT NULL,"
+        "  sha256 TEXT,"
+        "  created_at TEXT NOT NULL,"
+        "  UNIQUE(url, file_path)"
+        ");";
+
+    const char* chunksSql =
+        "CREATE TABLE IF NOT EXISTS chunk_hashes ("
+        "  url TEXT NOT NULL,"
+        "  file_path TEXT NOT NULL,"
+        "  chunk_size INTEGER NOT NULL,"
+        "  chunk_index INTEGER NOT NULL,"
+        "  digest BLOB NOT NULL,"
+        "  UNIQUE(url, file_path, chunk_index)"
+        ");";
+
+    const char* treeSql =
+        "CREATE TABLE IF NOT EXISTS tree_hashes ("
+        "  url TEXT NOT NULL,"
+        "  file_path TEXT NOT NULL,"
+        "  chunk_size INTEGER NOT NULL,"
+        "  chunk_count INTEGER NOT NULL,"
+        "  root TEXT NOT NULL,"
+        "  updated_at TEXT NOT NULL,"
+        "  UNIQUE(url, file_path)"
+        ");";
+
+    // one row per archived batch: data is the qCompress'ed JSON array of the downloads rows
+    const char* archiveSql =
+        "CREATE TABLE IF NOT EXISTS downloads_archive ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  archived_at TEXT NOT NULL,"
+        "  oldest TEXT NOT NULL,"
+        "  newest TEXT NOT NULL,"
+        "  row_count INTEGER NOT NULL,"
+        "  data BLOB NOT NULL"
+        ");";
+
+    const char* stagesSql =
+        "CREATE TABLE IF NOT EXISTS post_stages ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  url TEXT NOT NULL,"
+        "  file_path TEXT NOT NULL,"
+        "  stage TEXT NOT NULL,"
+        "  input TEXT,"
+        "  status TEXT NOT NULL,"
+        "  detail TEXT,"
+        "  started_at TEXT NOT NULL,"
+        "  duration_ms INTEGER NOT NULL DEFAULT 0"
+        ");";
+
+    return q.exec(sql)
+        && q.exec(mirrorsSql)
+        && q.exec(packSql)
+        && q.exec(chunksSql)
+        && q.exec(treeSql)
+        && q.exec(stagesSql)
+        && q.exec(archiveSql)
+        && q.exec("CREATE INDEX IF NOT EXISTS idx_post_stages_file ON post_stages(url, file_path);")
+        && q.exec("CREATE INDEX IF NOT EXISTS idx_downloads_updated ON downloads(updated_at);")
+        && addColumnIfMissing("downloads", "shared", "INTEGER NOT NULL DEFAULT 0")
+        && addColumnIfMissing("downloads", "lease_owner", "TEXT")
+        && addColumnIfMissing("downloads", "lease_expires", "INTEGER NOT NULL DEFAULT 0")
+        && addColumnIfMissing("downloads", "claims", "INTEGER NOT NULL DEFAULT 0")
+        && addColumnIfMissing("downloads", "validator", "TEXT")
+        && q.exec("CREATE INDEX IF NOT EXISTS idx_downloads_lease ON downloads(shared, lease_expires);")
+        && q.exec("CREATE INDEX IF NOT EXISTS idx_downloads_owner ON downloads(lease_owner);");
+}
+
+bool DBManager::addColumnIfMissing(const QString& table, const QString& column, const QString& decl)
+{
+    // databases created before the column existed
+    auto exists = [&]() {
+        QSqlQuery info(db);
+        if (!info.exec("PRAGMA table_info(" + table + ")"))
+            return false;
+        while (info.next())
+            if (info.value(1).toString() == column)
+                return true;
+        return false;
+    };
+    if (exists())
+        return true;
+
+    // a second instance starting at the same moment may win the race: fine as well
+    QSqlQuery q(db);
+    return q.exec("ALTER TABLE " + table + " ADD COLUMN " + column + " " + decl) || exists();
+}
+
+bool DBManager::beginBatch()
+{
+    return db.isValid() && db.isOpen() && db.transaction();
+}
+
+bool DBManager::commitBatch()
+{
+    TRACE_SPAN("db", "db.commitBatch", -1);
+
+    return db.isValid() && db.isOpen() && db.commit();
 }
 
 bool DBManager::addOrIgnoreQueued(const QString& url, const QString& filePath, const QString& fileName)
 {
+    TRACE_SPAN("db", "db.addOrIgnoreQueued", -1);
+
     QSqlQuery q(db);
     q.prepare(
         "INSERT OR IGNORE INTO downloads "
@@ -96,45 +240,573 @@ bool DBManager::addOrIgnoreQueued(const QString& url, const QString& filePath, c
     return q.exec();
 }
 
-bool DBManager::updateProgress(const QString& url, const QString& filePath, int progress)
+bool DBManager::updateProgress(const QString& url, const QString& filePath, int progress,
+                               const QString& owner)
 {
+    TRACE_SPAN("db", "db.updateProgress", -1);
+
     QSqlQuery q(db);
-    q.prepare("UPDATE downloads SET progress=?, updated_at=? WHERE url=? AND file_path=?");
+    q.prepare("UPDATE downloads SET progress=?, updated_at=? WHERE url=? AND file_path=?" + leaseGuard(owner));
     q.addBindValue(progress);
     q.addBindValue(nowIso());
     q.addBindValue(url);
     q.addBindValue(filePath);
-    return q.exec();
+    if (!owner.isEmpty())
+        q.addBindValue(owner);
+    return q.exec() && (owner.isEmpty() || q.numRowsAffected() > 0);
+}
+
+bool DBManager::updateProgressBatch(const QVector<ProgressUpdate>& updates)
+{
+    TRACE_SPAN("db", "db.updateProgressBatch", -1);
+
+    if (updates.isEmpty())
+        return true;
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    db.transaction();
+
+    const QString now = nowIso();
+    QSqlQuery q(db);
+    q.prepare("UPDATE downloads SET progress=?, updated_at=? WHERE url=? AND file_path=?");
+    QSqlQuery leased(db);
+    leased.prepare("UPDATE downloads SET progress=?, updated_at=? WHERE url=? AND file_path=? AND lease_owner=?");
+    for (const ProgressUpdate& u : updates) {
+        QSqlQuery& w = u.owner.isEmpty() ? q : leased;
+        w.addBindValue(u.progress);
+        w.addBindValue(now);
+        w.addBindValue(u.url);
+        w.addBindValue(u.filePath);
+        if (!u.owner.isEmpty())
+            w.addBindValue(u.owner);
+        if (!w.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
 }
 
-bool DBManager::updateStatus(const QString& url, const QString& filePath, const QString& status)
+bool DBManager::updateStatus(const QString& url, const QString& filePath, const QString& status,
+                             const QString& owner)
 {
+    TRACE_SPAN("db", "db.updateStatus", -1);
+
     QSqlQuery q(db);
-    q.prepare("UPDATE downloads SET status=?, updated_at=? WHERE url=? AND file_path=?");
+    q.prepare("UPDATE downloads SET status=?, updated_at=? WHERE url=? AND file_path=?" + leaseGuard(owner));
     q.addBindValue(status);
     q.addBindValue(nowIso());
     q.addBindValue(url);
     q.addBindValue(filePath);
-    return q.exec();
+    if (!owner.isEmpty())
+        q.addBindValue(owner);
+    return q.exec() && (owner.isEmpty() || q.numRowsAffected() > 0);
 }
 
-bool DBManager::setHashAndDone(const QString& url, const QString& filePath, const QString& sha256)
+bool DBManager::setHashAndDone(const QString& url, const QString& filePath, const QString& sha256,
+                               const QString& owner)
 {
+    TRACE_SPAN("db", "db.setHashAndDone", -1);
+
     QSqlQuery q(db);
     q.prepare(
         "UPDATE downloads "
         "SET sha256=?, status='Done', progress=100, updated_at=? "
-        "WHERE url=? AND file_path=?"
+        "WHERE url=? AND file_path=?" + leaseGuard(owner)
         );
     q.addBindValue(sha256);
     q.addBindValue(nowIso());
     q.addBindValue(url);
     q.addBindValue(filePath);
+    if (!owner.isEmpty())
+        q.addBindValue(owner);
+    return q.exec() && (owner.isEmpty() || q.numRowsAffected() > 0);
+}
+
+bool DBManager::recordChunkDigests(const QVector<ChunkDigest>& digests)
+{
+    TRACE_SPAN("db", "db.recordChunkDigests", -1);
+
+    if (digests.isEmpty())
+        return true;
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    db.transaction();
+
+    QSqlQuery q(db);
+    q.prepare(
+        "INSERT OR REPLACE INTO chunk_hashes "
+        "(url, file_path, chunk_size, chunk_index, digest) VALUES (?, ?, ?, ?, ?)"
+        );
+    for (const ChunkDigest& d : digests) {
+        q.addBindValue(d.url);
+        q.addBindValue(d.filePath);
+        q.addBindValue(d.chunkSize);
+        q.addBindValue(d.index);
+        q.addBindValue(d.digest);
+        if (!q.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
+
+bool DBManager::chunkDigests(const QString& url, const QString& filePath,
+                             qint64* chunkSize, QVector<QByteArray>* out) const
+{
+    TRACE_SPAN("db", "db.chunkDigests", -1);
+
+    out->clear();
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(
+        "SELECT chunk_size, chunk_index, digest FROM chunk_hashes "
+        "WHERE url=? AND file_path=? ORDER BY chunk_index"
+        );
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    if (!q.exec())
+        return false;
+
+    // a gap or a mixed chunk size ends the usable prefix
+    while (q.next()) {
+        const qint64 size = q.value(0).toLongLong();
+        if (out->isEmpty())
+            *chunkSize = size;
+        if (size != *chunkSize || q.value(1).toInt() != out->size())
+            break;
+        out->append(q.value(2).toByteArray());
+    }
+    return !out->isEmpty();
+}
+
+bool DBManager::setValidator(const QString& url, const QString& filePath, const QString& validator)
+{
+    TRACE_SPAN("db", "db.setValidator", -1);
+
+    QSqlQuery q(db);
+    q.prepare("UPDATE downloads SET validator=? WHERE url=? AND file_path=?");
+    q.addBindValue(validator.isEmpty() ? QVariant() : QVariant(validator));
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    return q.exec();
+}
+
+QString DBManager::validator(const QString& url, const QString& filePath) const
+{
+    if (!db.isValid() || !db.isOpen())
+        return QString();
+
+    QSqlQuery q(db);
+    q.prepare("SELECT validator FROM downloads WHERE url=? AND file_path=?");
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    if (!q.exec() || !q.next())
+        return QString();
+    return q.value(0).toString();
+}
+
+bool DBManager::setTreeHashAndDone(const QString& url, const QString& filePath, const QString& root,
+                                   qint64 chunkSize, const QVector<QByteArray>& digests,
+                                   const QString& owner)
+{
+    TRACE_SPAN("db", "db.setTreeHashAndDone", -1);
+
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    db.transaction();
+
+    const QString now = nowIso();
+    QSqlQuery del(db);
+    del.prepare("DELETE FROM chunk_hashes WHERE url=? AND file_path=?");
+    del.addBindValue(url);
+    del.addBindValue(filePath);
+    bool ok = del.exec();
+
+    QSqlQuery q(db);
+    q.prepare(
+        "INSERT INTO chunk_hashes "
+        "(url, file_path, chunk_size, chunk_index, digest) VALUES (?, ?, ?, ?, ?)"
+        );
+    for (int i = 0; ok && i < digests.size(); ++i) {
+        q.addBindValue(url);
+        q.addBindValue(filePath);
+        q.addBindValue(chunkSize);
+        q.addBindValue(i);
+        q.addBindValue(digests[i]);
+        ok = q.exec();
+    }
+
+    QSqlQuery tree(db);
+    tree.prepare(
+        "INSERT OR REPLACE INTO tree_hashes "
+        "(url, file_path, chunk_size, chunk_count, root, updated_at) VALUES (?, ?, ?, ?, ?, ?)"
+        );
+    tree.addBindValue(url);
+    tree.addBindValue(filePath);
+    tree.addBindValue(chunkSize);
+    tree.addBindValue(digests.size());
+    tree.addBindValue(root);
+    tree.addBindValue(now);
+    ok = ok && tree.exec();
+
+    QSqlQuery done(db);
+    done.prepare(
+        "UPDATE downloads "
+        "SET status='Done (tree)', progress=100, updated_at=? "
+        "WHERE url=? AND file_path=?" + leaseGuard(owner)
+        );
+    done.addBindValue(now);
+    done.addBindValue(url);
+    done.addBindValue(filePath);
+    if (!owner.isEmpty())
+        done.addBindValue(owner);
+    ok = ok && done.exec() && (owner.isEmpty() || done.numRowsAffected() > 0);
+
+    if (!ok) {
+        db.rollback();
+        return false;
+    }
+    return db.commit();
+}
+
+bool DBManager::recordStage(const StageRecord& r)
+{
+    TRACE_SPAN("db", "db.recordStage", -1);
+
+    QSqlQuery q(db);
+    q.prepare(
+        "INSERT INTO post_stages "
+        "(url, file_path, stage, input, status, detail, started_at, duration_ms) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?)"
+        );
+    q.addBindValue(r.url);
+    q.addBindValue(r.filePath);
+    q.addBindValue(r.stage);
+    q.addBindValue(r.input);
+    q.addBindValue(r.status);
+    q.addBindValue(r.detail);
+    q.addBindValue(r.startedAt);
+    q.addBindValue(r.durationMs);
+    return q.exec();
+}
+
+bool DBManager::publishJob(const QString& url, const QString& filePath, const QString& fileName)
+{
+    TRACE_SPAN("db", "db.publishJob", -1);
+
+    if (!addOrIgnoreQueued(url, filePath, fileName))
+        return false;
+
+    // a job somebody still holds a live lease on stays theirs
+    QSqlQuery q(db);
+    q.prepare(
+        "UPDATE downloads "
+        "SET shared=1, status='Queued', progress=0, claims=0, lease_owner=NULL, lease_expires=0, updated_at=? "
+        "WHERE url=? AND file_path=? AND status NOT LIKE 'Done%' "
+        "AND (lease_owner IS NULL OR lease_expires < ?)"
+        );
+    q.addBindValue(nowIso());
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    q.addBindValue(nowSecs());
     return q.exec();
 }
 
+QVector<ClaimedJob> DBManager::claimJobs(const QString& owner, int max, int leaseSecs, int maxClaims)
+{
+    TRACE_SPAN("db", "db.claimJobs", -1);
+
+    QVector<ClaimedJob> out;
+    if (!db.isValid() || !db.isOpen() || max <= 0)
+        return out;
+
+    // IMMEDIATE takes the write lock up front: two workers can never select the same rows
+    QSqlQuery q(db);
+    if (!q.exec("BEGIN IMMEDIATE"))
+        return out;
+
+    const qint64 now = nowSecs();
+    const QString stamp = nowIso();
+
+    QSqlQuery dead(db);
+    dead.prepare(QString(
+        "UPDATE downloads SET status='Error: abandoned after ' || claims || ' claims', "
+        "lease_owner=NULL, updated_at=? WHERE %1 AND claims >= ?").arg(CLAIMABLE));
+    dead.addBindValue(stamp);
+    dead.addBindValue(now);
+    dead.addBindValue(maxClaims);
+
+    QSqlQuery pick(db);
+    pick.prepare(QString(
+        "SELECT id, url, file_path, file_name, claims FROM downloads "
+        "WHERE %1 ORDER BY id LIMIT ?").arg(CLAIMABLE));
+    pick.addBindValue(now);
+    pick.addBindValue(max);
+
+    bool ok = dead.exec() && pick.exec();
+    while (ok && pick.next()) {
+        ClaimedJob j;
+        j.id = pick.value(0).toLongLong();
+        j.url = pick.value(1).toString();
+        j.filePath = pick.value(2).toString();
+        j.fileName = pick.value(3).toString();
+        j.claims = pick.value(4).toInt() + 1;
+        out.push_back(j);
+    }
+
+    QSqlQuery take(db);
+    take.prepare(
+        "UPDATE downloads SET lease_owner=?, lease_expires=?, claims=claims+1, "
+        "status='Claimed', updated_at=? WHERE id=?"
+        );
+    for (int i = 0; ok && i < out.size(); ++i) {
+        take.addBindValue(owner);
+        take.addBindValue(now + leaseSecs);
+        take.addBindValue(stamp);
+        take.addBindValue(out[i].id);
+        ok = take.exec();
+    }
+
+    if (!ok || !q.exec("COMMIT")) {
+        q.exec("ROLLBACK");
+        out.clear();
+    }
+    return out;
+}
+
+bool DBManager::renewLeases(const QString& owner, int leaseSecs, QSet<QString>* owned)
+{
+    TRACE_SPAN("db", "db.renewLeases", -1);
+
+    QSqlQuery q(db);
+    q.prepare("UPDATE downloads SET lease_expires=? WHERE lease_owner=? AND lease_expires > 0");
+    q.addBindValue(nowSecs() + leaseSecs);
+    q.addBindValue(owner);
+    if (!q.exec())
+        return false;
+    if (!owned)
+        return true;
+
+    // a job missing here was claimed by another worker after our lease ran out
+    QSqlQuery held(db);
+    held.prepare("SELECT url, file_path FROM downloads WHERE lease_owner=?");
+    held.addBindValue(owner);
+    if (!held.exec())
+        return false;
+
+    owned->clear();
+    while (held.next())
+        owned->insert(held.value(0).toString() + '\n' + held.value(1).toString());
+    return true;
+}
+
+bool DBManager::releaseLease(const QString& url, const QString& filePath, const QString& owner)
+{
+    TRACE_SPAN("db", "db.releaseLease", -1);
+
+    QSqlQuery q(db);
+    q.prepare(
+        "UPDATE downloads SET lease_owner=NULL, lease_expires=0 "
+        "WHERE url=? AND file_path=? AND lease_owner=?"
+        );
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    q.addBindValue(owner);
+    return q.exec();
+}
+
+bool DBManager::deferJob(const QString& url, const QString& filePath, const QString& owner,
+                         int delayMs, const QString& status)
+{
+    TRACE_SPAN("db", "db.deferJob", -1);
+
+    QSqlQuery q(db);
+    q.prepare(
+        "UPDATE downloads SET lease_owner=NULL, lease_expires=?, status=?, updated_at=? "
+        "WHERE url=? AND file_path=? AND lease_owner=?"
+        );
+    q.addBindValue(nowSecs() + (delayMs + 999) / 1000);
+    q.addBindValue(status);
+    q.addBindValue(nowIso());
+    q.addBindValue(url);
+    q.addBindValue(filePath);
+    q.addBindValue(owner);
+    return q.exec();
+}
+
+int DBManager::pendingShared() const
+{
+    TRACE_SPAN("db", "db.pendingShared", -1);
+
+    if (!db.isValid() || !db.isOpen())
+        return -1;
+
+    QSqlQuery q(db);
+    if (!q.exec("SELECT COUNT(*) FROM downloads WHERE shared=1 "
+                "AND status NOT LIKE 'Done%' AND status NOT LIKE 'Error%' AND status NOT LIKE 'Skipped%'")
+        || !q.next())
+        return -1;
+    return q.value(0).toInt();
+}
+
+bool DBManager::setMirrors(const QString& url, const QStringList& mirrors)
+{
+    TRACE_SPAN("db", "db.setMirrors", -1);
+
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    db.transaction();
+
+    QSqlQuery del(db);
+    del.prepare("DELETE FROM download_mirrors WHERE url=?");
+    del.addBindValue(url);
+    bool ok = del.exec();
+
+    QSqlQuery q(db);
+    q.prepare("INSERT OR IGNORE INTO download_mirrors (url, mirror_url, position) VALUES (?, ?, ?)");
+    for (int i = 0; ok && i < mirrors.size(); ++i) {
+        q.addBindValue(url);
+        q.addBindValue(mirrors[i]);
+        q.addBindValue(i);
+        ok = q.exec();
+    }
+
+    if (!ok) {
+        db.rollback();
+        return false;
+    }
+    return db.commit();
+}
+
+QStringList DBManager::mirrorsFor(const QString& url) const
+{
+    QStringList out;
+    if (!db.isValid() || !db.isOpen())
+        return out;
+
+    QSqlQuery q(db);
+    q.prepare("SELECT mirror_url FROM download_mirrors WHERE url=? ORDER BY position");
+    q.addBindValue(url);
+    if (!q.exec())
+        return out;
+
+    while (q.next())
+        out << q.value(0).toString();
+    return out;
+}
+
+QString DBManager::recordedSha256(const QString& url) const
+{
+    if (!db.isValid() || !db.isOpen())
+        return QString();
+
+    QSqlQuery q(db);
+    q.prepare(
+        "SELECT sha256 FROM downloads "
+        "WHERE url=? AND status LIKE 'Done%' AND sha256 IS NOT NULL AND sha256 <> '' "
+        "ORDER BY datetime(updated_at) DESC LIMIT 1"
+        );
+    q.addBindValue(url);
+    if (!q.exec() || !q.next())
+        return QString();
+    return q.value(0).toString();
+}
+
+bool DBManager::recordPackedBatch(const QVector<PackedEntry>& entries)
+{
+    TRACE_SPAN("db", "db.recordPackedBatch", -1);
+
+    if (entries.isEmpty())
+        return true;
+    if (!db.isValid() || !db.isOpen())
+        return false;
+
+    db.transaction();
+
+    const QString now = nowIso();
+    QSqlQuery idx(db);
+    idx.prepare(
+        "INSERT OR REPLACE INTO pack_index "
+        "(url, file_path, pack_path, data_offset, size, sha256, created_at) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?)"
+        );
+    QSqlQuery done(db);
+    done.prepare(
+        "UPDATE downloads "
+        "SET sha256=?, status='Done (packed)', progress=100, updated_at=? "
+        "WHERE url=? AND file_path=?"
+        );
+    QSqlQuery leased(db);
+    leased.prepare(
+        "UPDATE downloads "
+        "SET sha256=?, status='Done (packed)', progress=100, updated_at=? "
+        "WHERE url=? AND file_path=? AND lease_owner=?"
+        );
+
+    for (const PackedEntry& e : entries) {
+        QSqlQuery& w = e.owner.isEmpty() ? done : leased;
+        w.addBindValue(e.sha256);
+        w.addBindValue(now);
+        w.addBindValue(e.url);
+        w.addBindValue(e.filePath);
+        if (!e.owner.isEmpty())
+            w.addBindValue(e.owner);
+        if (!w.exec()) {
+            db.rollback();
+            return false;
+        }
+        if (!e.owner.isEmpty() && w.numRowsAffected() == 0)
+            continue;   // lease taken over: the other worker's copy is the one on record
+
+        idx.addBindValue(e.url);
+        idx.addBindValue(e.filePath);
+        idx.addBindValue(e.packPath);
+        idx.addBindValue(e.offset);
+        idx.addBindValue(e.size);
+        idx.addBindValue(e.sha256);
+        idx.addBindValue(now);
+        if (!idx.exec()) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    return db.commit();
+}
+
+QHash<QString, QString> DBManager::completedAt() const
+{
+    TRACE_SPAN("db", "db.completedAt", -1);
+
+    QHash<QString, QString> out;
+    if (!db.isValid() || !db.isOpen())
+        return out;
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT url, MAX(updated_at) FROM downloads WHERE status LIKE 'Done%' GROUP BY url"))
+        return out;
+
+    while (q.next())
+        out.insert(q.value(0).toString(), q.value(1).toString());
+    return out;
+}
+
 QVector<DownloadRecord> DBManager::fetchRecent(int limit) const
 {
+    TRACE_SPAN("db", "db.fetchRecent", -1);
+
     QVector<DownloadRecord> out;
     if (!db.isValid() || !db.isOpen())
         return out;
@@ -166,10 +838,234 @@ QVector<DownloadRecord> DBManager::fetchRecent(int limit) const
     return out;
 }
 
+QVector<DownloadRecord> DBManager::fetchUpdatedSince(const QString& sinceIso, int limit) const
+{
+    TRACE_SPAN("db", "db.fetchUpdatedSince", -1);
+
+    QVector<DownloadRecord> out;
+    if (!db.isValid() || !db.isOpen())
+        return out;
+
+    QSqlQuery q(db);
+    q.prepare(
+        "SELECT url, file_path, file_name, status, progress, sha256, updated_at "
+        "FROM downloads "
+        "WHERE updated_at >= ? "
+        "ORDER BY updated_at ASC "
+        "LIMIT ?"
+        );
+    q.addBindValue(sinceIso);
+    q.addBindValue(limit);
+
+    if (!q.exec())
+        return out;
+
+    while (q.next()) {
+        DownloadRecord r;
+        r.url = q.value(0).toString();
+        r.filePath = q.value(1).toString();
+        r.fileName = q.value(2).toString();
+        r.status = q.value(3).toString();
+        r.progress = q.value(4).toInt();
+        r.sha256 = q.value(5).toString();
+        r.updatedAt = q.value(6).toString();
+        out.push_back(r);
+    }
+
+    return out;
+}
+
 bool DBManager::clearAll()
 {
+    TRACE_SPAN("db", "db.clearAll", -1);
+
     if (!db.isValid() || !db.isOpen())
         return false;
     QSqlQuery q(db);
     return q.exec("DELETE FROM downloads;");
 }
+
+int DBManager::archiveBatch(const RetentionPolicy& policy)
+{
+    TRACE_SPAN("db", "db.archiveBatch", -1);
+
+    if (!db.isValid() || !db.isOpen())
+        return -1;
+    if (policy.statuses.isEmpty() || (policy.maxAgeDays <= 0 && policy.maxRows <= 0))
+        return 0;
+
+    // older than the age limit, or not among the newest maxRows ('' matches nothing)
+    QString ageCutoff;
+    if (policy.maxAgeDays > 0)
+        ageCutoff = QDateTime::currentDateTimeUtc().addDays(-policy.maxAgeDays).toString(Qt::ISODate);
+
+    QString countCutoff;
+    if (policy.maxRows > 0) {
+        QSqlQuery nth(db);
+        nth.prepare("SELECT updated_at FROM downloads ORDER BY updated_at DESC LIMIT 1 OFFSET ?");
+        nth.addBindValue(policy.maxRows);
+        if (!nth.exec())
+            return -1;
+        if (nth.next())
+            countCutoff = nth.value(0).toString();
+    }
+
+    if (ageCutoff.isEmpty() && countCutoff.isEmpty())
+        return 0;
+
+    QStringList statusTerms;
+    for (int i = 0; i < policy.statuses.size(); ++i)
+        statusTerms << "status LIKE ?";
+
+    if (!db.transaction())
+        return -1;
+
+    QSqlQuery pick(db);
+    pick.prepare(
+        "SELECT id, url, file_path, file_name, status, progress, sha256, created_at, updated_at "
+        "FROM downloads WHERE (" + statusTerms.join(" OR ") + ") "
+        "AND (updated_at < ? OR updated_at <= ?) "
+        "AND (lease_owner IS NULL OR lease_expires < ?) "
+        "ORDER BY updated_at ASC LIMIT ?"
+        );
+    for (const QString& st : policy.statuses)
+        pick.addBindValue(st + "%");
+    pick.addBindValue(ageCutoff);
+    pick.addBindValue(countCutoff);
+    pick.addBindValue(nowSecs());
+    pick.addBindValue(qMax(1, policy.batchRows));
+
+    QJsonArray rows;
+    QVector<qint64> ids;
+    QVector<QPair<QString, QString>> keys;
+    bool ok = pick.exec();
+    while (ok && pick.next()) {
+        QJsonObject o;
+        o["id"] = pick.value(0).toLongLong();
+        o["url"] = pick.value(1).toString();
+        o["file_path"] = pick.value(2).toString();
+        o["file_name"] = pick.value(3).toString();
+        o["status"] = pick.value(4).toString();
+        o["progress"] = pick.value(5).toInt();
+        o["sha256"] = pick.value(6).toString();
+        o["created_at"] = pick.value(7).toString();
+        o["updated_at"] = pick.value(8).toString();
+        rows.append(o);
+
+        ids.push_back(pick.value(0).toLongLong());
+        keys.push_back({ pick.value(1).toString(), pick.value(2).toString() });
+    }
+
+    // post-processing history goes along with its row: one entry per stage, oldest first
+    QSqlQuery stages(db);
+    stages.prepare(
+        "SELECT stage, input, status, detail, started_at, duration_ms FROM post_stages "
+        "WHERE url=? AND file_path=? ORDER BY id"
+        );
+    for (int i = 0; ok && i < ids.size(); ++i) {
+        stages.addBindValue(keys[i].first);
+        stages.addBindValue(keys[i].second);
+        ok = stages.exec();
+
+        QJsonArray runs;
+        while (ok && stages.next()) {
+            QJsonObject st;
+            st["stage"] = stages.value(0).toString();
+            st["input"] = stages.value(1).toString();
+            st["status"] = stages.value(2).toString();
+            st["detail"] = stages.value(3).toString();
+            st["started_at"] = stages.value(4).toString();
+            st["duration_ms"] = stages.value(5).toLongLong();
+            runs.append(st);
+        }
+        if (!runs.isEmpty()) {
+            QJsonObject o = rows[i].toObject();
+            o["post_stages"] = runs;
+            rows[i] = o;
+        }
+    }
+
+    if (ok && !ids.isEmpty()) {
+        QSqlQuery put(db);
+        put.prepare("INSERT INTO downloads_archive (archived_at, oldest, newest, row_count, data) VALUES (?, ?, ?, ?, ?)");
+        put.addBindValue(nowIso());
+        put.addBindValue(rows.first().toObject().value("updated_at").toString());
+        put.addBindValue(rows.last().toObject().value("updated_at").toString());
+        put.addBindValue(ids.size());
+        put.addBindValue(qCompress(QJsonDocument(rows).toJson(QJsonDocument::Compact), 9));
+        ok = put.exec();
+
+        // chunk digests only serve resuming, which finished rows no longer need
+        QSqlQuery del(db);
+        del.prepare("DELETE FROM downloads WHERE id=?");
+        QSqlQuery delChunks(db);
+        delChunks.prepare("DELETE FROM chunk_hashes WHERE url=? AND file_path=?");
+        QSqlQuery delStages(db);
+        delStages.prepare("DELETE FROM post_stages WHERE url=? AND file_path=?");
+        for (int i = 0; ok && i < ids.size(); ++i) {
+            del.addBindValue(ids[i]);
+            delChunks.addBindValue(keys[i].first);
+            delChunks.addBindValue(keys[i].second);
+            delStages.addBindValue(keys[i].first);
+            delStages.addBindValue(keys[i].second);
+            ok = del.exec() && delChunks.exec() && delStages.exec();
+        }
+    }
+
+    if (!ok || !db.commit()) {
+        db.rollback();
+        return -1;
+    }
+    return ids.size();
+}
+
+bool DBManager::incrementalVacuum(int pages)
+{
+    TRACE_SPAN("db", "db.incrementalVacuum", -1);
+
+    QSqlQuery q(db);
+    if (!q.exec(QString("PRAGMA incremental_vacuum(%1);").arg(qMax(1, pages))))
+        return false;
+    while (q.next()) {}   // each step frees one page
+    return true;
+}
+
+bool DBManager::checkpoint()
+{
+    TRACE_SPAN("db", "db.checkpoint", -1);
+
+    QSqlQuery q(db);
+    return q.exec("PRAGMA wal_checkpoint(PASSIVE);");
+}
+
+bool DBManager::compact()
+{
+    TRACE_SPAN("db", "db.compact", -1);
+
+    QSqlQuery q(db);
+    return q.exec("PRAGMA auto_vacuum=INCREMENTAL;")
+        && q.exec("VACUUM;")
+        && q.exec("PRAGMA wal_checkpoint(TRUNCATE);");
+}
+
+DbStats DBManager::stats() const
+{
+    DbStats s;
+    if (!db.isValid() || !db.isOpen())
+        return s;
+
+    auto scalar = [this](const QString& sql) -> qint64 {
+        QSqlQuery q(db);
+        return q.exec(sql) && q.next() ? q.value(0).toLongLong() : 0;
+    };
+
+    const qint64 pageSize = scalar("PRAGMA page_size;");
+    s.fileBytes = scalar("PRAGMA page_count;") * pageSize;
+    s.freeBytes = scalar("PRAGMA freelist_count;") * pageSize;
+    s.incrementalVacuum = scalar("PRAGMA auto_vacuum;") == 2;
+    s.walBytes = QFileInfo(db.databaseName() + "-wal").size();
+    s.downloads = scalar("SELECT COUNT(*) FROM downloads;");
+    s.archivedRows = scalar("SELECT COALESCE(SUM(row_count), 0) FROM downloads_archive;");
+    s.archiveBatches = scalar("SELECT COUNT(*) FROM downloads_archive;");
+    return s;
+}
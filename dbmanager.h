@@ -3,8 +3,13 @@
 
 
 #include <QString>
+#include <QByteArray>
 #include <QSqlDatabase>
 #include <QVector>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QMetaType>
 
 struct DownloadRecord {
     QString url;
@@ -16,28 +21,153 @@ struct DownloadRecord {
     QString updatedAt;
 };
 
+struct ProgressUpdate {
+    QString url;
+    QString filePath;
+    int progress = 0;
+    QString owner;       // claimed jobs: only written while this worker holds the lease
+};
+
+struct PackedEntry {
+    QString url;
+    QString filePath;
+    QString packPath;
+    qint64 offset = 0;
+    qint64 size = 0;
+    QString sha256;
+    QString owner;   // leased job: recorded only while the lease is still ours
+};
+
+struct ChunkDigest {
+    QString url;
+    QString filePath;
+    qint64 chunkSize = 0;
+    int index = 0;
+    QByteArray digest;   // raw SHA-256 of the chunk
+};
+
+struct StageRecord {
+    QString url;
+    QString filePath;
+    QString stage;
+    QString input;       // file the stage ran on (the download or something extracted from it)
+    QString status;      // ok / failed / skipped
+    QString detail;
+    QString startedAt;
+    qint64 durationMs = 0;
+};
+
+struct ClaimedJob {
+    qint64 id = 0;
+    QString url;
+    QString filePath;
+    QString fileName;
+    int claims = 0;      // how often the job has been handed out, this claim included
+};
+
+// What the history keeps: terminal rows older than maxAgeDays or beyond the newest
+// maxRows move to downloads_archive, their post_stages runs with them. Active and
+// leased jobs are never touched.
+struct RetentionPolicy {
+    int maxAgeDays = 0;          // 0 = no age limit
+    int maxRows = 0;             // 0 = no row limit
+    QStringList statuses;        // status prefixes that may go ("Done", "Error", "Skipped")
+    int batchRows = 500;         // rows per transaction
+};
+Q_DECLARE_METATYPE(RetentionPolicy)
+
+struct DbStats {
+    qint64 fileBytes = 0;
+    qint64 walBytes = 0;
+    qint64 freeBytes = 0;        // free pages incremental vacuum can hand back
+    qint64 downloads = 0;
+    qint64 archivedRows = 0;
+    qint64 archiveBatches = 0;
+    bool incrementalVacuum = false;
+};
+Q_DECLARE_METATYPE(DbStats)
+
 class DBManager {
 public:
     DBManager();
     ~DBManager();
 
-    bool openDefault();               // opens AppDataLocation/scraper.db
-    bool openAtPath(const QString& dbPath);
+    // rollbackJournal: DB on a filesystem without shared memory (network share) used by
+    // several processes; WAL otherwise. Every process must use the same mode, so the open
+    // fails when SQLite does not end up in the requested one.
+    bool openDefault(bool rollbackJournal = false);   // opens AppDataLocation/scraper.db
+    bool openAtPath(const QString& dbPath, bool rollbackJournal = false);
     void close();
+    QString path() const { return db.databaseName(); }
 
-    bool ensureSchema();
+    bool ensureSchema(bool rollbackJournal = false);
 
-    // Core functions you will call from MainWindow:
+    // Wrap many single-row calls (e.g. queueing thousands of discovered URLs) in one transaction
+    bool beginBatch();
+    bool commitBatch();
+
+    // Core functions you will call from MainWindow. A non-empty owner limits the write to
+    // a job that owner still holds the lease on; false when it no longer does.
     bool addOrIgnoreQueued(const QString& url, const QString& filePath, const QString& fileName);
-    bool updateProgress(const QString& url, const QString& filePath, int progress);
-    bool updateStatus(const QString& url, const QString& filePath, const QString& status);
-    bool setHashAndDone(const QString& url, const QString& filePath, const QString& sha256);
+    bool updateProgress(const QString& url, const QString& filePath, int progress,
+                        const QString& owner = QString());
+    bool updateProgressBatch(const QVector<ProgressUpdate>& updates);   // one transaction
+    bool updateStatus(const QString& url, const QString& filePath, const QString& status,
+                      const QString& owner = QString());
+    bool setHashAndDone(const QString& url, const QString& filePath, const QString& sha256,
+                        const QString& owner = QString());
+
+    // Pack mode: index entries + Done/sha256 for many small files in one transaction
+    bool recordPackedBatch(const QVector<PackedEntry>& entries);
+
+    // Tree hashing: per-chunk digests (written while downloading) and the final Merkle root
+    bool recordChunkDigests(const QVector<ChunkDigest>& digests);   // one transaction
+    bool chunkDigests(const QString& url, const QString& filePath,
+                      qint64* chunkSize, QVector<QByteArray>* out) const; // leading contiguous chunks
+    bool setTreeHashAndDone(const QString& url, const QString& filePath, const QString& root,
+                            qint64 chunkSize, const QVector<QByteArray>& digests,
+                            const QString& owner = QString());
+    // ETag or Last-Modified of the full response the bytes on disk came from (If-Range on resume)
+    bool setValidator(const QString& url, const QString& filePath, const QString& validator);
+    QString validator(const QString& url, const QString& filePath) const;
+
+    // Post-processing: one row per stage run
+    bool recordStage(const StageRecord& r);
+
+    // Mirrors: equivalent URLs for a job, keyed by its primary URL
+    bool setMirrors(const QString& url, const QStringList& mirrors);
+    QStringList mirrorsFor(const QString& url) const;
+    QString recordedSha256(const QString& url) const;
+    QHash<QString, QString> completedAt() const;   // url -> updated_at of its last Done record
+
+    // Shared job queue: published jobs are claimed under a lease that the owner keeps
+    // renewing; a job whose lease ran out is handed to the next worker that asks.
+    bool publishJob(const QString& url, const QString& filePath, const QString& fileName);
+    QVector<ClaimedJob> claimJobs(const QString& owner, int max, int leaseSecs, int maxClaims = 5);
+    // owned: url '\n' file_path of every job the owner still holds after renewing
+    bool renewLeases(const QString& owner, int leaseSecs, QSet<QString>* owned = nullptr);
+    bool releaseLease(const QString& url, const QString& filePath, const QString& owner);
+    // retry later, on whichever worker claims it first once delayMs has passed
+    bool deferJob(const QString& url, const QString& filePath, const QString& owner,
+                  int delayMs, const QString& status);
+    // shared jobs not finished yet, leased and deferred ones included; -1 on error
+    int pendingShared() const;
 
     // History
     QVector<DownloadRecord> fetchRecent(int limit = 200) const;
+    QVector<DownloadRecord> fetchUpdatedSince(const QString& sinceIso, int limit = 200) const; // oldest first
     bool clearAll();
 
+    // Retention: one short transaction per call, so other writers only ever wait for one batch
+    int archiveBatch(const RetentionPolicy& policy);   // rows archived, -1 on error
+    bool incrementalVacuum(int pages);
+    bool checkpoint();        // passive: copies what it can without waiting on anyone
+    bool compact();           // full VACUUM; also turns on incremental vacuum for older files
+    DbStats stats() const;
+
 private:
+    bool addColumnIfMissing(const QString& table, const QString& column, const QString& decl);
+
     QString connName;
     QSqlDatabase db;
 };
@@ -1,44 +1,286 @@
 #include "filewriter.h"
+#include "packfile.h"
+#include "tracer.h"
 
 #include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <cstring>
 
-void FileWriterWorker::openFile(int row, QString path) {
-    if (files.contains(row) && files[row]) {
-        QFile* old = files[row];
+FileWriterWorker::~FileWriterWorker() {
+    for (QFile* f : files) {
+        f->flush();
+        f->close();
+        delete f;
+    }
+    delete pack;
+}
+
+void FileWriterWorker::setPackMode(bool enabled, QString packDir, qint64 threshold) {
+    packMode = enabled;
+    packThreshold = threshold;
+
+    // files already held in memory must not lose their destination
+    if (!enabled) {
+        const auto jobs = buffered.keys();
+        for (int job : jobs)
+            spill(job);
+    }
+
+    if (pack && (!enabled || pack->directory() != packDir)) {
+        delete pack;
+        pack = nullptr;
+    }
+    if (enabled && !pack)
+        pack = new PackWriter(packDir);
+}
+
+void FileWriterWorker::setTreeChunkSize(qint64 chunkSize) {
+    // chunks in flight were cut at the old size and can no longer line up
+    if (chunkSize != treeChunkSize)
+        chunking.clear();
+    treeChunkSize = qMax<qint64>(0, chunkSize);
+}
+
+void FileWriterWorker::startChunks(int job, int firstIndex) {
+    chunking.remove(job);
+    if (treeChunkSize <= 0) return;
+
+    RunningChunk c;
+    c.hash = std::make_shared<QCryptographicHash>(QCryptographicHash::Sha256);
+    c.index = firstIndex;
+    chunking.insert(job, c);
+}
+
+void FileWriterWorker::hashAppended(int job, const QByteArray& data) {
+    auto it = chunking.find(job);
+    if (it == chunking.end()) return;
+
+    const char* p = data.constData();
+    qint64 left = data.size();
+    while (left > 0) {
+        const qint64 take = qMin(left, treeChunkSize - it->filled);
+        it->hash->addData(QByteArray::fromRawData(p, int(take)));
+        it->filled += take;
+        p += take;
+        left -= take;
+
+        if (it->filled == treeChunkSize) {
+            emit chunkHashed(job, it->index, it->hash->result());
+            it->hash->reset();
+            it->filled = 0;
+            ++it->index;
+        }
+    }
+}
+
+void FileWriterWorker::finishChunks(int job) {
+    auto it = chunking.find(job);
+    if (it == chunking.end()) return;
+
+    // the short tail chunk only exists once the file is complete
+    if (it->filled > 0)
+        emit chunkHashed(job, it->index, it->hash->result());
+    chunking.erase(it);
+}
+
+void FileWriterWorker::fail(int job, const QString& message) {
+    failed.insert(job);
+    emit writeError(job, message);
+}
+
+void FileWriterWorker::openFile(int job, QString path) {
+    TRACE_SPAN("writer", "open", job);
+
+    if (files.contains(job) && files[job]) {
+        QFile* old = files[job];
         old->flush();
         old->close();
         delete old;
-        files.remove(row);
+        files.remove(job);
+    }
+    buffered.remove(job);
+    failed.remove(job);
+    startChunks(job, 0);
+
+    if (packMode) {
+        Buffered b;
+        b.path = path;
+        buffered.insert(job, b);
+        emit fileOpened(job, path);
+        return;
     }
 
     QFile *f = new QFile(path);
     if (!f->open(QIODevice::WriteOnly)) {
         delete f;
-        emit writeError(row, "Cannot open file for writing");
+        fail(job, "Cannot open file for writing");
+        return;
+    }
+    files[job] = f;
+    emit fileOpened(job, path);
+}
+
+void FileWriterWorker::openFileAt(int job, QString path, qint64 offset) {
+    TRACE_SPAN("writer", "open", job);
+
+    if (QFile* old = files.take(job)) {
+        old->flush();
+        old->close();
+        delete old;
+    }
+    buffered.remove(job);
+    chunking.remove(job);
+    failed.remove(job);
+
+    QFile *f = new QFile(path);
+    if (!f->open(QIODevice::ReadWrite)
+        || (offset >= 0 && (!f->resize(offset) || !f->seek(offset)))) {
+        delete f;
+        fail(job, "Cannot open file for writing");
+        return;
+    }
+    files[job] = f;
+    if (offset >= 0 && treeChunkSize > 0 && offset % treeChunkSize == 0)
+        startChunks(job, int(offset / treeChunkSize));
+    emit fileOpened(job, path);
+}
+
+bool FileWriterWorker::spill(int job) {
+    // grew past the pack threshold: becomes a regular file after all
+    const Buffered b = buffered.take(job);
+
+    QFile *f = new QFile(b.path);
+    if (!f->open(QIODevice::WriteOnly) || f->write(b.data) < 0) {
+        delete f;
+        fail(job, "Cannot open file for writing");
+        return false;
+    }
+    files[job] = f;
+    return true;
+}
+
+void FileWriterWorker::appendChunk(int job, QByteArray chunk) {
+    TRACE_SPAN("writer", "append", job);
+
+    hashAppended(job, chunk);
+
+    auto b = buffered.find(job);
+    if (b != buffered.end()) {
+        b->data.append(chunk);
+        if (b->data.size() > packThreshold)
+            spill(job);
         return;
     }
-    files[row] = f;
-    emit fileOpened(row, path);
+
+    auto it = files.find(job);
+    if (it == files.end() || !it.value()) return;
+
+    QFile* f = it.value();
+    if (f->write(chunk) < 0) {
+        fail(job, "Write failed");
+    }
 }
 
-void FileWriterWorker::appendChunk(int row, QByteArray chunk) {
-    auto it = files.find(row);
+void FileWriterWorker::writeAt(int job, qint64 offset, QByteArray chunk) {
+    TRACE_SPAN("writer", "writeAt", job);
+
+    chunking.remove(job); // out-of-order writes: digests come from the tree hash only
+
+    auto b = buffered.find(job);
+    if (b != buffered.end()) {
+        const qint64 end = offset + chunk.size();
+        if (end > packThreshold) {
+            if (!spill(job)) return;
+        } else {
+            if (b->data.size() < end) b->data.resize(int(end));
+            memcpy(b->data.data() + offset, chunk.constData(), size_t(chunk.size()));
+            return;
+        }
+    }
+
+    auto it = files.find(job);
     if (it == files.end() || !it.value()) return;
 
     QFile* f = it.value();
+    if (f->pos() != offset && !f->seek(offset)) {
+        fail(job, "Seek failed");
+        return;
+    }
     if (f->write(chunk) < 0) {
-        emit writeError(row, "Write failed");
+        fail(job, "Write failed");
+    }
+}
+
+void FileWriterWorker::closeFile(int job) {
+    Trace::asyncEnd("writer", "close-queue", job);
+    TRACE_SPAN("writer", "close", job);
+
+    auto b = buffered.find(job);
+    if (b != buffered.end()) {
+        const Buffered small = b.value();
+        buffered.erase(b);
+        chunking.remove(job);
+
+        // hashed straight from memory: packed files never need a second read
+        QString packPath;
+        const qint64 offset = pack ? pack->append(QFileInfo(small.path).fileName(), small.data, &packPath) : -1;
+        if (offset < 0) {
+            emit writeError(job, "Cannot append to pack");
+            return;
+        }
+
+        const QString digest = QCryptographicHash::hash(small.data, QCryptographicHash::Sha256).toHex();
+        emit filePacked(job, packPath, offset, small.data.size(), digest);
+        return;
+    }
+
+    // every close is answered: fileClosed, or an error (possibly reported earlier)
+    const bool reported = failed.remove(job);
+    QFile* f = files.take(job);
+    if (!f) {
+        chunking.remove(job);
+        if (!reported)
+            emit writeError(job, "File is not open");
+        return;
+    }
+
+    f->flush();
+    f->close();
+    delete f;
+
+    if (reported) {
+        chunking.remove(job);
+        return;
     }
+    finishChunks(job);
+    emit fileClosed(job);
 }
 
-void FileWriterWorker::closeFile(int row) {
-    auto it = files.find(row);
+void FileWriterWorker::abortFile(int job) {
+    buffered.remove(job);
+    failed.remove(job);
+    chunking.remove(job); // complete chunks were already reported; the tail is re-fetched
+
+    auto it = files.find(job);
     if (it == files.end() || !it.value()) return;
 
     QFile* f = it.value();
     f->flush();
     f->close();
     delete f;
-    files.remove(row);
-    emit fileClosed(row);
+    files.remove(job);
+}
+
+void FileWriterWorker::discardFile(int job) {
+    buffered.remove(job);
+    failed.remove(job);
+    chunking.remove(job);
+
+    QFile* f = files.take(job);
+    if (!f) return;
+
+    f->close();
+    f->remove();
+    delete f;
 }
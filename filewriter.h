@@ -4,26 +4,73 @@
 
 #include <QObject>
 #include <QHash>
+#include <QSet>
+#include <memory>
 
 class QFile;
+class QCryptographicHash;
+class PackWriter;
 
 class FileWriterWorker : public QObject {
     Q_OBJECT
 public:
     explicit FileWriterWorker(QObject* parent = nullptr) : QObject(parent) {}
+    ~FileWriterWorker() override;
 
 public slots:
-    void openFile(int row, QString path);
-    void appendChunk(int row, QByteArray chunk);
-    void closeFile(int row);
+    void openFile(int job, QString path);
+    // Reopens an existing file: keeps the first offset bytes and appends after them.
+    // A negative offset keeps the whole file for in-place repair via writeAt().
+    void openFileAt(int job, QString path, qint64 offset);
+    void appendChunk(int job, QByteArray chunk);
+    void writeAt(int job, qint64 offset, QByteArray chunk);
+    void closeFile(int job);
+    void abortFile(int job);   // failed transfer: close, and drop anything not yet on disk
+    void discardFile(int job); // unwanted after all: close and delete it
+
+    // Pack mode: files that stay under threshold are kept in memory and appended to
+    // rolling tar packs in packDir instead of being created one by one.
+    void setPackMode(bool enabled, QString packDir, qint64 threshold);
+
+    // Tree hashing: sequentially appended data is hashed in chunkSize pieces as it
+    // passes through, so a partial file can be verified before it is resumed. 0 = off.
+    void setTreeChunkSize(qint64 chunkSize);
 
 signals:
-    void fileOpened(int row, QString path);
-    void fileClosed(int row);
-    void writeError(int row, QString message);
+    void fileOpened(int job, QString path);
+    void fileClosed(int job);
+    void filePacked(int job, QString packPath, qint64 offset, qint64 size, QString sha256);
+    void writeError(int job, QString message);
+    void chunkHashed(int job, int index, QByteArray digest);
 
 private:
-    QHash<int, QFile*> files; // row -> file handle (worker thread only)
+    struct Buffered {
+        QString path;
+        QByteArray data;
+    };
+
+    struct RunningChunk {
+        std::shared_ptr<QCryptographicHash> hash;
+        qint64 filled = 0;
+        int index = 0;
+    };
+
+    void fail(int job, const QString& message);
+    bool spill(int job);
+    void startChunks(int job, int firstIndex);
+    void hashAppended(int job, const QByteArray& data);
+    void finishChunks(int job);
+
+    QHash<int, QFile*> files; // job -> file handle (worker thread only)
+    QHash<int, Buffered> buffered; // job -> small file still in memory (pack mode)
+    QSet<int> failed;              // jobs with an error reported since they were opened
+
+    bool packMode = false;
+    qint64 packThreshold = 256 * 1024;
+    PackWriter* pack = nullptr;
+
+    qint64 treeChunkSize = 0;
+    QHash<int, RunningChunk> chunking; // job -> chunk being hashed (sequential writes only)
 };
 
 #endif
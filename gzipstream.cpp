@@ -0,0 +1,78 @@
+#include "gzipstream.h"
+
+#include <zlib.h>
+
+GzipStream::GzipStream(Format format)
+    : format(format)
+{
+    z = new z_stream();
+    // 15 + 32: accept both gzip and zlib headers; -15: raw deflate, no header at all
+    if (inflateInit2(z, format == RawDeflate ? -15 : 15 + 32) != Z_OK) {
+        delete z;
+        z = nullptr;
+        error = "zlib init failed";
+    }
+}
+
+GzipStream::~GzipStream()
+{
+    if (z) {
+        inflateEnd(z);
+        delete z;
+    }
+}
+
+bool GzipStream::looksCompressed(const QByteArray& head)
+{
+    return head.size() >= 2
+        && static_cast<unsigned char>(head[0]) == 0x1f
+        && static_cast<unsigned char>(head[1]) == 0x8b;
+}
+
+bool GzipStream::feed(const char* data, qint64 len, QByteArray* out)
+{
+    if (!z) return false;
+
+    char buf[64 * 1024];
+    z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    z->avail_in = uInt(len);
+
+    while (z->avail_in > 0) {
+        z->next_out = reinterpret_cast<Bytef*>(buf);
+        z->avail_out = sizeof(buf);
+
+        const int rc = inflate(z, Z_NO_FLUSH);
+        out->append(buf, int(sizeof(buf) - z->avail_out));
+
+        if (rc == Z_STREAM_END) {
+            ended = true;
+            // another gzip member may follow (e.g. files produced by `cat a.gz b.gz`)
+            if (format == GzipOrZlib && z->avail_in > 0 && inflateReset(z) == Z_OK) {
+                ended = false;
+                continue;
+            }
+            break;
+        }
+        if (rc == Z_BUF_ERROR)
+            break;                   // needs more input
+        if (rc != Z_OK) {
+            error = z->msg ? QString::fromLatin1(z->msg) : QString("corrupt compressed data");
+            return false;
+        }
+    }
+
+    // drain output still buffered inside zlib for the input consumed so far
+    while (!ended) {
+        z->next_out = reinterpret_cast<Bytef*>(buf);
+        z->avail_out = sizeof(buf);
+
+        const int rc = inflate(z, Z_NO_FLUSH);
+        const int produced = int(sizeof(buf) - z->avail_out);
+        out->append(buf, produced);
+
+        if (rc == Z_STREAM_END) ended = true;
+        if (produced == 0 || (rc != Z_OK && rc != Z_STREAM_END)) break;
+    }
+
+    return true;
+}
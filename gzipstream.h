@@ -0,0 +1,40 @@
+#ifndef GZIPSTREAM_H
+#define GZIPSTREAM_H
+
+
+#include <QByteArray>
+#include <QString>
+
+struct z_stream_s;
+
+// Incremental zlib inflater: feed compressed bytes as they arrive, get plain bytes
+// back, never holding more than one chunk of either in memory.
+// Accepts gzip (including concatenated members) and zlib streams, or headerless
+// deflate data as stored inside zip archives.
+class GzipStream {
+public:
+    enum Format { GzipOrZlib, RawDeflate };
+
+    explicit GzipStream(Format format = GzipOrZlib);
+    ~GzipStream();
+
+    GzipStream(const GzipStream&) = delete;
+    GzipStream& operator=(const GzipStream&) = delete;
+
+    // Appends the inflated output of in to *out; false on corrupt input.
+    bool feed(const char* data, qint64 len, QByteArray* out);
+    bool feed(const QByteArray& in, QByteArray* out) { return feed(in.constData(), in.size(), out); }
+
+    bool atEnd() const { return ended; }
+    QString errorString() const { return error; }
+
+    static bool looksCompressed(const QByteArray& head);   // gzip magic
+
+private:
+    z_stream_s* z = nullptr;
+    Format format;
+    bool ended = false;
+    QString error;
+};
+
+#endif
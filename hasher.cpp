@@ -1,20 +1,129 @@
 #include "hasher.h"
+#include "tracer.h"
 
-#include <QFile>
+#include <QFileInfo>
 #include <QCryptographicHash>
+#include <QtConcurrent>
 
-void HasherWorker::hashFile(int row, QString filePath)
+#include <functional>
+
+namespace {
+
+// Returns an empty array when the chunk cannot be read in full.
+QByteArray hashChunk(const QString& filePath, qint64 offset, qint64 length)
+{
+    thread_local BlockReader reader;   // one per pool thread, kept between chunks
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    qint64 seen = 0;
+    const bool ok = reader.read(filePath, [&](const char* data, qint64 len) {
+        hash.addData(QByteArray::fromRawData(data, int(len)));
+        seen += len;
+    }, offset, length);
+
+    if (!ok || seen != length)
+        return QByteArray();
+    return hash.result();
+}
+
+QVector<QByteArray> hashChunks(const QString& filePath, qint64 size, qint64 chunkSize, int count)
+{
+    QVector<int> indexes(count);
+    for (int i = 0; i < count; ++i)
+        indexes[i] = i;
+
+    const std::function<QByteArray(int)> one = [filePath, size, chunkSize](int i) {
+        const qint64 offset = qint64(i) * chunkSize;
+        return hashChunk(filePath, offset, qMin(chunkSize, size - offset));
+    };
+    return QtConcurrent::blockingMapped<QVector<QByteArray>>(indexes, one);
+}
+
+} // namespace
+
+QByteArray HasherWorker::merkleRoot(QVector<QByteArray> level)
+{
+    if (level.isEmpty())
+        return QCryptographicHash::hash(QByteArray(), QCryptographicHash::Sha256);
+
+    while (level.size() > 1) {
+        QVector<QByteArray> next;
+        next.reserve((level.size() + 1) / 2);
+        for (int i = 0; i + 1 < level.size(); i += 2) {
+            QCryptographicHash h(QCryptographicHash::Sha256);
+            h.addData(QByteArray(1, '\x01'));
+            h.addData(level[i]);
+            h.addData(level[i + 1]);
+            next.append(h.result());
+        }
+        if (level.size() % 2)
+            next.append(level.last());
+        level.swap(next);
+    }
+    return level.first();
+}
+
+void HasherWorker::hashFile(int job, QString filePath)
 {
-    QFile f(filePath);
-    if (!f.open(QIODevice::ReadOnly)) {
-        emit hashError(row, "Cannot open file for hashing");
+    Trace::asyncEnd("hash", "hash-queue", job);
+    TRACE_SPAN("hash", "sha256", job);
+
+    if (!QFileInfo::exists(filePath)) {
+        emit hashError(job, "Cannot open file for hashing");
         return;
     }
 
+    // the next block is read (or paged in) while this one is hashed
     QCryptographicHash hash(QCryptographicHash::Sha256);
-    while (!f.atEnd()) {
-        hash.addData(f.read(1024 * 1024)); // 1MB chunks
+    const bool ok = reader.read(filePath, [&hash](const char* data, qint64 len) {
+        hash.addData(QByteArray::fromRawData(data, int(len)));
+    });
+    if (!ok) {
+        emit hashError(job, "Read error while hashing: " + reader.errorString());
+        return;
     }
     const QString digest = hash.result().toHex();
-    emit hashReady(row, digest);
+    emit hashReady(job, digest);
+}
+
+void HasherWorker::hashFileTree(int job, QString filePath, qint64 chunkSize)
+{
+    Trace::asyncEnd("hash", "hash-queue", job);
+    TRACE_SPAN("hash", "merkle", job);
+
+    const QFileInfo fi(filePath);
+    if (!fi.exists() || chunkSize <= 0) {
+        emit hashError(job, "Cannot open file for hashing");
+        return;
+    }
+
+    const qint64 size = fi.size();
+    const int count = size == 0 ? 1 : int((size + chunkSize - 1) / chunkSize);
+    const QVector<QByteArray> digests = size == 0
+        ? QVector<QByteArray>{ QCryptographicHash::hash(QByteArray(), QCryptographicHash::Sha256) }
+        : hashChunks(filePath, size, chunkSize, count);
+
+    for (const QByteArray& d : digests) {
+        if (d.isEmpty()) {
+            emit hashError(job, "Read error while hashing");
+            return;
+        }
+    }
+    emit treeHashReady(job, QString(merkleRoot(digests).toHex()), chunkSize, digests);
+}
+
+void HasherWorker::verifyChunks(int job, QString filePath, qint64 chunkSize, QVector<QByteArray> expected)
+{
+    TRACE_SPAN("hash", "verify-chunks", job);
+
+    const qint64 size = QFileInfo(filePath).size();
+    int count = 0;
+    if (chunkSize > 0)
+        count = int(qMin<qint64>(expected.size(), size / chunkSize));
+
+    const QVector<QByteArray> actual = hashChunks(filePath, size, chunkSize, count);
+    int good = 0;
+    while (good < count && !actual[good].isEmpty() && actual[good] == expected[good])
+        ++good;
+    emit chunksVerified(job, good);
 }
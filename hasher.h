@@ -2,18 +2,35 @@
 #define HASHERWORKER_H
 
 #include <QObject>
+#include <QVector>
+#include <QByteArray>
+
+#include "blockreader.h"
 
 class HasherWorker : public QObject {
     Q_OBJECT
 public:
     explicit HasherWorker(QObject* parent=nullptr) : QObject(parent) {}
 
+    // Leaves are plain SHA-256 of each chunk; a parent is SHA-256(0x01 | left | right)
+    // and an odd node at the end of a level is carried up unchanged.
+    static QByteArray merkleRoot(QVector<QByteArray> level);
+
 public slots:
-    void hashFile(int row, QString filePath);
+    void hashFile(int job, QString filePath);
+    // Hashes fixed-size chunks on the global thread pool and combines them into a root.
+    void hashFileTree(int job, QString filePath, qint64 chunkSize);
+    // Counts how many leading chunks on disk still match the recorded digests.
+    void verifyChunks(int job, QString filePath, qint64 chunkSize, QVector<QByteArray> expected);
 
 signals:
-    void hashReady(int row, QString digestHex);
-    void hashError(int row, QString message);
+    void hashReady(int job, QString digestHex);
+    void hashError(int job, QString message);
+    void treeHashReady(int job, QString rootHex, qint64 chunkSize, QVector<QByteArray> chunkDigests);
+    void chunksVerified(int job, int goodChunks);
+
+private:
+    BlockReader reader;   // buffers reused from file to file
 };
 
 #endif
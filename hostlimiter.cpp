@@ -0,0 +1,85 @@
+#include "hostlimiter.h"
+
+#include <QDateTime>
+#include <QtGlobal>
+
+static qint64 nowMs()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+HostLimiter::HostState& HostLimiter::state(const QString& host)
+{
+    auto it = hosts.find(host);
+    if (it == hosts.end()) {
+        HostState s;
+        s.limit = initialLimit;
+        it = hosts.insert(host, s);
+    }
+    return it.value();
+}
+
+bool HostLimiter::tryAcquire(const QString& host)
+{
+    if (total >= maxTotal) return false;
+
+    HostState& s = state(host);
+    if (s.blockedUntilMs > nowMs()) return false;
+    if (s.active >= int(s.limit)) return false;
+
+    s.active++;
+    total++;
+    return true;
+}
+
+void HostLimiter::release(const QString& host)
+{
+    auto it = hosts.find(host);
+    if (it == hosts.end() || it->active == 0) return;
+    it->active--;
+    total--;
+}
+
+void HostLimiter::onSuccess(const QString& host)
+{
+    HostState& s = state(host);
+    const int ceiling = s.ceiling > 0 ? s.ceiling : maxLimit;
+    s.limit = qMin<double>(ceiling, s.limit + 1.0 / qMax(1.0, s.limit));
+}
+
+void HostLimiter::onCongestion(const QString& host)
+{
+    HostState& s = state(host);
+    const qint64 now = nowMs();
+
+    // One burst of simultaneous 429s is one congestion event, not N halvings.
+    if (now - s.lastDecreaseMs < decreaseCooldownMs) return;
+
+    s.limit = qMax<double>(minLimit, s.limit / 2.0);
+    s.lastDecreaseMs = now;
+}
+
+void HostLimiter::holdOff(const QString& host, int ms)
+{
+    HostState& s = state(host);
+    s.blockedUntilMs = qMax(s.blockedUntilMs, nowMs() + ms);
+}
+
+void HostLimiter::setCeiling(const QString& host, int ceiling)
+{
+    HostState& s = state(host);
+    s.ceiling = ceiling;
+    s.limit = qMin<double>(s.limit, ceiling > 0 ? ceiling : maxLimit);
+}
+
+int HostLimiter::limit(const QString& host) const
+{
+    auto it = hosts.constFind(host);
+    return it == hosts.constEnd() ? initialLimit : int(it->limit);
+}
+
+int HostLimiter::active(const QString& host) const
+{
+    auto it = hosts.constFind(host);
+    return it == hosts.constEnd() ? 0 : it->active;
+}
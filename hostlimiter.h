@@ -0,0 +1,45 @@
+#ifndef HOSTLIMITER_H
+#define HOSTLIMITER_H
+
+
+#include <QHash>
+#include <QString>
+
+// Per-host concurrency window, adapted AIMD-style: grows by ~1 slot per window of
+// successful transfers and halves when the host signals congestion.
+class HostLimiter {
+public:
+    int minLimit = 1;
+    int maxLimit = 16;
+    int initialLimit = 4;
+    int maxTotal = 32;
+    int decreaseCooldownMs = 2000;
+
+    bool tryAcquire(const QString& host);
+    void release(const QString& host);
+
+    void onSuccess(const QString& host);
+    void onCongestion(const QString& host);
+    void holdOff(const QString& host, int ms);   // e.g. Retry-After on 429
+    void setCeiling(const QString& host, int ceiling); // e.g. higher for multiplexed HTTP/2 hosts
+
+    int limit(const QString& host) const;
+    int active(const QString& host) const;
+    int totalActive() const { return total; }
+
+private:
+    struct HostState {
+        double limit = 0;
+        int active = 0;
+        qint64 lastDecreaseMs = 0;
+        qint64 blockedUntilMs = 0;
+        int ceiling = 0;    // 0 = maxLimit
+    };
+
+    HostState& state(const QString& host);
+
+    QHash<QString, HostState> hosts;
+    int total = 0;
+};
+
+#endif
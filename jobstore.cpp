@@ -0,0 +1,102 @@
+#include "jobstore.h"
+
+#include <QUrl>
+#include <cstring>
+
+int JobStore::add(const QString& url, const QString& path)
+{
+    if (urlIndex.contains(QStringView(url)))
+        return -1;
+
+    const int job = size();
+    urls.push_back(intern(url));
+    paths.push_back(intern(path));
+
+    const QString host = QUrl(url).host();
+    auto h = hostIndex.constFind(host);
+    if (h == hostIndex.constEnd()) {
+        h = hostIndex.insert(host, hostNames.size());
+        hostNames.push_back(host);
+    }
+    hostIds.push_back(h.value());
+
+    static const QString queued("Queued");
+    phases.push_back(Phase::Queued);
+    statuses.push_back(queued);
+    progresses.push_back(0);
+    receivedBytes.push_back(0);
+    totalBytes.push_back(0);
+    rows.push_back(-1);
+
+    urlIndex.insert(urlView(job), job);
+    return job;
+}
+
+int JobStore::find(QStringView url) const
+{
+    return urlIndex.value(url, -1);
+}
+
+void JobStore::setPath(int job, const QString& path)
+{
+    if (pathView(job) == QStringView(path)) return;
+    paths[job] = intern(path);   // the old bytes stay behind; paths rarely change
+}
+
+void JobStore::setStatus(int job, const QString& text)
+{
+    statuses[job] = text;
+    phases[job] = phaseOf(text);
+}
+
+JobStore::Phase JobStore::phaseOf(const QString& status)
+{
+    if (status.startsWith("Queued (shared)") || status.startsWith("Claimed")) return Phase::Shared;
+    if (status.startsWith("Queued"))      return Phase::Queued;
+    if (status.startsWith("Waiting"))     return Phase::Waiting;
+    if (status.startsWith("Downloading")) return Phase::Downloading;
+    if (status.startsWith("Verifying"))   return Phase::Verifying;
+    if (status.startsWith("Repairing"))   return Phase::Repairing;
+    if (status.startsWith("Retrying"))    return Phase::Retrying;
+    if (status.startsWith("Downloaded") || status.startsWith("Repaired")) return Phase::Hashing;
+    if (status.startsWith("Done"))        return Phase::Done;
+    if (status.startsWith("Error"))       return Phase::Error;
+    if (status.startsWith("Skipped"))     return Phase::Skipped;
+    return Phase::Queued;
+}
+
+void JobStore::setBytes(int job, qint64 received, qint64 total)
+{
+    receivedBytes[job] = received;
+    totalBytes[job] = total;
+}
+
+void JobStore::setRow(int job, int row)
+{
+    rows[job] = row;
+    while (rowJobs.size() <= row)
+        rowJobs.push_back(-1);
+    rowJobs[row] = job;
+}
+
+JobStore::Span JobStore::intern(QStringView s)
+{
+    const quint32 len = quint32(s.size());
+
+    // anything longer than a block gets a block of its own
+    if (blocks.empty() || len > BLOCK_CHARS - blockUsed) {
+        blocks.emplace_back(new QChar[qMax(BLOCK_CHARS, len)]);
+        blockUsed = 0;
+    }
+
+    Span span;
+    span.block = quint32(blocks.size() - 1);
+    span.offset = blockUsed;
+    span.length = len;
+    if (len)
+        std::memcpy(blocks.back().get() + blockUsed, s.data(), len * sizeof(QChar));
+
+    // an oversized block is full right away
+    blockUsed = len >= BLOCK_CHARS ? BLOCK_CHARS : blockUsed + len;
+    return span;
+}
@@ -0,0 +1,88 @@
+#ifndef JOBSTORE_H
+#define JOBSTORE_H
+
+
+#include <QHash>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// Every download the window knows about, addressed by a stable job id (0, 1, 2, ...;
+// never reused). Per-job state is kept column by column so scans and updates touch
+// only the array they need. URLs and paths are written once into an append-only
+// arena; hosts are interned, so all jobs of one host share a single string.
+class JobStore {
+public:
+    enum class Phase : quint8 {
+        Queued, Shared, Waiting, Downloading, Verifying, Repairing, Retrying,
+        Hashing, Done, Error, Skipped
+    };
+
+    // -1 when the URL is already a job
+    int add(const QString& url, const QString& path);
+    int find(QStringView url) const;   // -1 if unknown
+
+    int size() const { return int(phases.size()); }
+    bool contains(int job) const { return job >= 0 && job < size(); }
+
+    // Views stay valid for the lifetime of the store.
+    QStringView urlView(int job) const { return view(urls[job]); }
+    QStringView pathView(int job) const { return view(paths[job]); }
+    QString url(int job) const { return urlView(job).toString(); }
+    QString path(int job) const { return pathView(job).toString(); }
+    void setPath(int job, const QString& path);
+
+    const QString& host(int job) const { return hostNames[hostIds[job]]; }
+
+    // The status text is what the table shows; its phase is derived once, here.
+    Phase phase(int job) const { return phases[job]; }
+    const QString& statusText(int job) const { return statuses[job]; }
+    void setStatus(int job, const QString& text);
+    static Phase phaseOf(const QString& status);
+
+    int progress(int job) const { return progresses[job]; }
+    void setProgress(int job, int percent) { progresses[job] = qint8(qBound(0, percent, 100)); }
+
+    qint64 received(int job) const { return receivedBytes[job]; }
+    qint64 total(int job) const { return totalBytes[job]; }
+    void setBytes(int job, qint64 received, qint64 total);
+
+    // Table row showing the job (rows are only ever appended, but keep the two apart)
+    int row(int job) const { return rows[job]; }
+    int jobAt(int row) const { return row >= 0 && row < rowJobs.size() ? rowJobs[row] : -1; }
+    void setRow(int job, int row);
+
+private:
+    struct Span {
+        quint32 block = 0;
+        quint32 offset = 0;
+        quint32 length = 0;
+    };
+
+    Span intern(QStringView s);
+    QStringView view(const Span& s) const { return QStringView(blocks[s.block].get() + s.offset, qsizetype(s.length)); }
+
+    // arena: fixed-size blocks, never moved once written, so views into them stay valid
+    static constexpr quint32 BLOCK_CHARS = 64 * 1024;
+    std::vector<std::unique_ptr<QChar[]>> blocks;
+    quint32 blockUsed = BLOCK_CHARS;
+
+    QVector<Span> urls;
+    QVector<Span> paths;
+    QVector<int> hostIds;
+    QVector<Phase> phases;
+    QVector<QString> statuses;
+    QVector<qint8> progresses;
+    QVector<qint64> receivedBytes;
+    QVector<qint64> totalBytes;
+    QVector<int> rows;
+    QVector<int> rowJobs;
+
+    QHash<QStringView, int> urlIndex;   // keys point into the arena
+    QHash<QString, int> hostIndex;
+    QVector<QString> hostNames;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "linkfilter.h"
+
+#include <QSettings>
+#include <algorithm>
+
+static int trieSlot(QChar c)
+{
+    const ushort u = c.unicode();
+    if (u >= 'a' && u <= 'z') return u - 'a';
+    if (u >= 'A' && u <= 'Z') return u - 'A';
+    if (u >= '0' && u <= '9') return 26 + (u - '0');
+    if (u == '.') return 36;
+    if (u == '-') return 37;
+    if (u == '_') return 38;
+    return -1;
+}
+
+static QString globToRegex(const QString& glob)
+{
+    QString out;
+    out.reserve(glob.size() * 2);
+    for (const QChar c : glob) {
+        if (c == '*') out += ".*";
+        else if (c == '?') out += '.';
+        else out += QRegularExpression::escape(QString(c));
+    }
+    return out;
+}
+
+static QRegularExpression combine(const QStringList& patterns, QStringList* errors, bool* any)
+{
+    QStringList parts;
+    for (const QString& raw : patterns) {
+        const QString p = raw.trimmed();
+        if (p.isEmpty()) continue;
+
+        const QString re = p.startsWith("re:") ? p.mid(3) : "^" + globToRegex(p) + "$";
+        if (!QRegularExpression(re).isValid()) {
+            *errors << p;
+            continue;
+        }
+        parts << "(?:" + re + ")";
+    }
+
+    *any = !parts.isEmpty();
+    QRegularExpression combined(parts.join('|'), QRegularExpression::CaseInsensitiveOption);
+    combined.optimize();
+    return combined;
+}
+
+// -------------------- FilterRules --------------------
+FilterRules FilterRules::defaults()
+{
+    FilterRules r;
+    r.extensions = {
+        "png", "jpg", "jpeg", "webp", "gif", "svg", "ico",
+        "pdf", "zip", "rar", "7z",
+        "bin", "hex", "txt", "csv", "json", "xml",
+        "mp4", "mp3", "wav"
+    };
+    return r;
+}
+
+FilterRules FilterRules::load(QSettings& settings, const QString& profile)
+{
+    settings.beginGroup("filters/" + profile);
+    if (settings.childKeys().isEmpty()) {
+        settings.endGroup();
+        return defaults();
+    }
+
+    FilterRules r;
+    r.include      = settings.value("include").toStringList();
+    r.exclude      = settings.value("exclude").toStringList();
+    r.allowHosts   = settings.value("allowHosts").toStringList();
+    r.denyHosts    = settings.value("denyHosts").toStringList();
+    r.extensions   = settings.value("extensions").toStringList();
+    r.mimeTypes    = settings.value("mimeTypes").toStringList();
+    r.minSize      = settings.value("minSize", 0).toLongLong();
+    r.maxSize      = settings.value("maxSize", 0).toLongLong();
+    r.sameHostOnly = settings.value("sameHostOnly", true).toBool();
+    settings.endGroup();
+    return r;
+}
+
+void FilterRules::save(QSettings& settings, const QString& profile) const
+{
+    settings.beginGroup("filters/" + profile);
+    settings.setValue("include", include);
+    settings.setValue("exclude", exclude);
+    settings.setValue("allowHosts", allowHosts);
+    settings.setValue("denyHosts", denyHosts);
+    settings.setValue("extensions", extensions);
+    settings.setValue("mimeTypes", mimeTypes);
+    settings.setValue("minSize", minSize);
+    settings.setValue("maxSize", maxSize);
+    settings.setValue("sameHostOnly", sameHostOnly);
+    settings.endGroup();
+}
+
+QStringList FilterRules::profiles(QSettings& settings)
+{
+    settings.beginGroup("filters");
+    QStringList out = settings.childGroups();
+    settings.endGroup();
+    if (!out.contains("default"))
+        out.prepend("default");
+    return out;
+}
+
+// -------------------- LinkFilter --------------------
+LinkFilter::TrieNode::TrieNode()
+{
+    std::fill(std::begin(next), std::end(next), -1);
+}
+
+void LinkFilter::addExtension(const QString& ext)
+{
+    QString suffix = ext.trimmed().toLower();
+    while (suffix.startsWith('.') || suffix.startsWith('*'))
+        suffix.remove(0, 1);
+    if (suffix.isEmpty()) return;
+    suffix.prepend('.');
+
+    int node = 0;
+    for (int i = suffix.size() - 1; i >= 0; --i) {
+        const int k = trieSlot(suffix[i]);
+        if (k < 0) return;   // not something a file extension is made of
+        if (trie[node].next[k] < 0) {
+            trie[node].next[k] = int(trie.size());
+            trie.emplace_back();
+        }
+        node = trie[node].next[k];
+    }
+    trie[node].terminal = true;
+}
+
+bool LinkFilter::hasListedExtension(const QString& path) const
+{
+    // walks the path backwards, no lowercased copy
+    int node = 0;
+    for (int i = path.size() - 1; i >= 0; --i) {
+        const int k = trieSlot(path[i]);
+        if (k < 0) return false;
+        node = trie[node].next[k];
+        if (node < 0) return false;
+        if (trie[node].terminal) return true;
+    }
+    return false;
+}
+
+static void splitHosts(const QStringList& rules, QSet<QString>* exact, QSet<QString>* domains)
+{
+    for (const QString& raw : rules) {
+        QString h = raw.trimmed().toLower();
+        if (h.startsWith('=')) {
+            h.remove(0, 1);
+            if (!h.isEmpty()) exact->insert(h);
+            continue;
+        }
+        if (h.startsWith("*.")) h.remove(0, 2);
+        if (!h.isEmpty()) domains->insert(h);
+    }
+}
+
+QStringList LinkFilter::compile(const FilterRules& rules)
+{
+    QStringList errors;
+
+    allowExact.clear(); allowDomains.clear(); denyExact.clear(); denyDomains.clear();
+    splitHosts(rules.allowHosts, &allowExact, &allowDomains);
+    splitHosts(rules.denyHosts, &denyExact, &denyDomains);
+    sameHostOnly = rules.sameHostOnly;
+
+    includeRe = combine(rules.include, &errors, &hasInclude);
+    excludeRe = combine(rules.exclude, &errors, &hasExclude);
+
+    trie.assign(1, TrieNode());
+    for (const QString& e : rules.extensions)
+        addExtension(e);
+
+    minSize = rules.minSize;
+    maxSize = rules.maxSize;
+    mimeExact.clear();
+    mimePrefixes.clear();
+    for (const QString& raw : rules.mimeTypes) {
+        const QString m = raw.trimmed().toLower();
+        if (m.isEmpty()) continue;
+        if (m.endsWith("/*")) mimePrefixes << m.left(m.size() - 1);
+        else mimeExact.insert(m);
+    }
+
+    return errors;
+}
+
+bool LinkFilter::hostIn(const QString& host, const QSet<QString>& exact, const QSet<QString>& domains)
+{
+    if (exact.contains(host)) return true;
+    if (domains.isEmpty()) return false;
+
+    // a.b.example.com: try a.b.example.com, b.example.com, example.com, com
+    for (int from = 0; ; ) {
+        if (domains.contains(from == 0 ? host : host.mid(from))) return true;
+        from = host.indexOf('.', from);
+        if (from < 0) return false;
+        ++from;
+    }
+}
+
+bool LinkFilter::acceptsWithBaseHost(const QUrl& u, const QString& baseHost) const
+{
+    const QString host = u.host();   // QUrl keeps hosts lowercased
+
+    if (hostIn(host, denyExact, denyDomains))
+        return false;
+    if (!allowExact.isEmpty() || !allowDomains.isEmpty()) {
+        if (!hostIn(host, allowExact, allowDomains))
+            return false;
+    } else if (sameHostOnly && !host.isEmpty() && host != baseHost) {
+        return false;
+    }
+
+    const bool hasExtensions = trie.size() > 1;
+    if (!hasInclude && !hasExclude && !hasExtensions)
+        return true;
+
+    // the common case never touches a regex
+    const bool listed = hasExtensions && hasListedExtension(u.path());
+    if (listed && !hasExclude)
+        return true;
+    if (!hasInclude && !hasExclude)
+        return false;
+
+    const QString full = u.toString(QUrl::RemoveFragment);
+    if (hasExclude && excludeRe.match(full).hasMatch())
+        return false;
+    if (listed)
+        return true;
+    if (hasInclude)
+        return includeRe.match(full).hasMatch();
+    return !hasExtensions;   // exclude rules only
+}
+
+bool LinkFilter::accepts(const QUrl& u, const QUrl& base) const
+{
+    return acceptsWithBaseHost(u, base.host());
+}
+
+QVector<bool> LinkFilter::evaluate(const QList<QUrl>& urls, const QUrl& base) const
+{
+    const QString baseHost = base.host();
+    QVector<bool> out(urls.size());
+    for (int i = 0; i < urls.size(); ++i)
+        out[i] = acceptsWithBaseHost(urls[i], baseHost);
+    return out;
+}
+
+bool LinkFilter::acceptsResponse(qint64 size, const QString& contentType, QString* reason) const
+{
+    if (size >= 0 && minSize > 0 && size < minSize) {
+        if (reason) *reason = QString("smaller than %1 KiB").arg(minSize / 1024);
+        return false;
+    }
+    if (size >= 0 && maxSize > 0 && size > maxSize) {
+        if (reason) *reason = QString("larger than %1 KiB").arg(maxSize / 1024);
+        return false;
+    }
+
+    if (mimeExact.isEmpty() && mimePrefixes.isEmpty())
+        return true;
+
+    const QString type = contentType.section(';', 0, 0).trimmed().toLower();
+    if (type.isEmpty() || mimeExact.contains(type))
+        return true;
+    for (const QString& prefix : mimePrefixes)
+        if (type.startsWith(prefix)) return true;
+
+    if (reason) *reason = "type " + type;
+    return false;
+}
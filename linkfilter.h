@@ -0,0 +1,79 @@
+#ifndef LINKFILTER_H
+#define LINKFILTER_H
+
+
+#include <QList>
+#include <QRegularExpression>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+#include <QVector>
+#include <vector>
+
+class QSettings;
+
+// What a filter profile says, as the user wrote it. Stored under filters/<profile>/.
+struct FilterRules {
+    QStringList include;      // globs on the full URL ("*.pdf", "*/files/*"), "re:" prefix for a regex
+    QStringList exclude;
+    QStringList allowHosts;   // "example.com" also covers its subdomains, "=example.com" only itself
+    QStringList denyHosts;
+    QStringList extensions;   // "pdf", "tar.gz", ...
+    QStringList mimeTypes;    // "application/pdf", "image/*"; checked once the response headers arrive
+    qint64 minSize = 0;       // bytes, 0 = no limit
+    qint64 maxSize = 0;
+    bool sameHostOnly = true; // when allowHosts is empty: only the page's own host
+
+    static FilterRules defaults();
+    static FilterRules load(QSettings& settings, const QString& profile);
+    void save(QSettings& settings, const QString& profile) const;
+
+    static QStringList profiles(QSettings& settings);
+};
+
+// FilterRules compiled once into lookup structures: host sets walked label by label,
+// a reversed suffix trie for extensions and one combined regex per include/exclude list.
+// A link passes when its host is allowed, no exclude pattern matches, and it either
+// matches an include pattern or has a listed extension (no patterns and no extensions:
+// everything passes).
+class LinkFilter {
+public:
+    LinkFilter() { compile(FilterRules::defaults()); }
+
+    // Returns the patterns that failed to compile (they are left out).
+    QStringList compile(const FilterRules& rules);
+
+    bool accepts(const QUrl& u, const QUrl& base) const;
+    QVector<bool> evaluate(const QList<QUrl>& urls, const QUrl& base) const;
+
+    // Size / MIME rules; size < 0 or an empty type means "not known", which passes.
+    bool hasResponseRules() const { return minSize > 0 || maxSize > 0 || !mimeExact.isEmpty() || !mimePrefixes.isEmpty(); }
+    bool acceptsResponse(qint64 size, const QString& contentType, QString* reason = nullptr) const;
+
+private:
+    struct TrieNode {
+        int next[39];
+        bool terminal = false;
+        TrieNode();
+    };
+
+    bool acceptsWithBaseHost(const QUrl& u, const QString& baseHost) const;
+    static bool hostIn(const QString& host, const QSet<QString>& exact, const QSet<QString>& domains);
+    bool hasListedExtension(const QString& path) const;
+    void addExtension(const QString& ext);
+
+    QSet<QString> allowExact, allowDomains, denyExact, denyDomains;
+    bool sameHostOnly = true;
+
+    QRegularExpression includeRe, excludeRe;
+    bool hasInclude = false, hasExclude = false;
+
+    std::vector<TrieNode> trie;   // reversed ".ext" suffixes, node 0 is the root
+
+    qint64 minSize = 0, maxSize = 0;
+    QSet<QString> mimeExact;
+    QStringList mimePrefixes;     // "image/" for "image/*"
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "linkfilterdialog.h"
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLineEdit>
+#include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QRegularExpression>
+#include <QSettings>
+#include <QSpinBox>
+#include <QVBoxLayout>
+
+static QStringList words(const QString& text)
+{
+    return text.split(QRegularExpression("[\\s,]+"), Qt::SkipEmptyParts);
+}
+
+static QStringList lines(const QString& text)
+{
+    QStringList out;
+    for (const QString& l : text.split('\n')) {
+        const QString t = l.trimmed();
+        if (!t.isEmpty()) out << t;
+    }
+    return out;
+}
+
+LinkFilterDialog::LinkFilterDialog(QSettings& settings, const QString& activeProfile, QWidget* parent)
+    : QDialog(parent)
+    , settings(settings)
+{
+    setWindowTitle("Link filter");
+
+    profileBox = new QComboBox(this);
+    profileBox->setEditable(true);
+    profileBox->addItems(FilterRules::profiles(settings));
+    profileBox->setCurrentText(activeProfile);
+
+    includeEdit = new QPlainTextEdit(this);
+    includeEdit->setPlaceholderText("one per line: *.pdf, */downloads/*, re:\\d{4}\\.csv$");
+    excludeEdit = new QPlainTextEdit(this);
+    excludeEdit->setPlaceholderText("one per line, same syntax");
+    allowHostsEdit = new QLineEdit(this);
+    allowHostsEdit->setPlaceholderText("example.com (with subdomains), =cdn.example.com (exact)");
+    denyHostsEdit = new QLineEdit(this);
+    sameHostBox = new QCheckBox("only the page's own host when no hosts are allowed above", this);
+    extensionsEdit = new QLineEdit(this);
+    extensionsEdit->setPlaceholderText("pdf zip tar.gz ...");
+    mimeEdit = new QLineEdit(this);
+    mimeEdit->setPlaceholderText("application/pdf image/*");
+
+    minSizeBox = new QSpinBox(this);
+    maxSizeBox = new QSpinBox(this);
+    for (QSpinBox* b : { minSizeBox, maxSizeBox }) {
+        b->setRange(0, 2147483647);
+        b->setSuffix(" KiB");
+        b->setSpecialValueText("no limit");
+    }
+
+    auto* form = new QFormLayout;
+    form->addRow("Profile", profileBox);
+    form->addRow("Include", includeEdit);
+    form->addRow("Exclude", excludeEdit);
+    form->addRow("Allow hosts", allowHostsEdit);
+    form->addRow("Deny hosts", denyHostsEdit);
+    form->addRow("", sameHostBox);
+    form->addRow("Extensions", extensionsEdit);
+    form->addRow("MIME types", mimeEdit);
+    form->addRow("Min size", minSizeBox);
+    form->addRow("Max size", maxSizeBox);
+
+    auto* buttons = new QDialogButtonBox(QDialogButtonBox::Save | QDialogButtonBox::Cancel, this);
+    connect(buttons, &QDialogButtonBox::accepted, this, &LinkFilterDialog::onSave);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->addLayout(form);
+    layout->addWidget(buttons);
+
+    connect(profileBox, &QComboBox::currentTextChanged, this, &LinkFilterDialog::onProfileChanged);
+    showRules(FilterRules::load(settings, activeProfile));
+}
+
+QString LinkFilterDialog::profile() const
+{
+    const QString name = profileBox->currentText().trimmed();
+    return name.isEmpty() ? QString("default") : name;
+}
+
+void LinkFilterDialog::onProfileChanged(const QString& name)
+{
+    // unknown names start from the current fields, so a profile can be cloned by renaming
+    if (FilterRules::profiles(settings).contains(name.trimmed()))
+        showRules(FilterRules::load(settings, name.trimmed()));
+}
+
+void LinkFilterDialog::showRules(const FilterRules& r)
+{
+    includeEdit->setPlainText(r.include.join('\n'));
+    excludeEdit->setPlainText(r.exclude.join('\n'));
+    allowHostsEdit->setText(r.allowHosts.join(' '));
+    denyHostsEdit->setText(r.denyHosts.join(' '));
+    sameHostBox->setChecked(r.sameHostOnly);
+    extensionsEdit->setText(r.extensions.join(' '));
+    mimeEdit->setText(r.mimeTypes.join(' '));
+    minSizeBox->setValue(int(qMin<qint64>(r.minSize / 1024, minSizeBox->maximum())));
+    maxSizeBox->setValue(int(qMin<qint64>(r.maxSize / 1024, maxSizeBox->maximum())));
+}
+
+FilterRules LinkFilterDialog::rules() const
+{
+    FilterRules r;
+    r.include = lines(includeEdit->toPlainText());
+    r.exclude = lines(excludeEdit->toPlainText());
+    r.allowHosts = words(allowHostsEdit->text());
+    r.denyHosts = words(denyHostsEdit->text());
+    r.sameHostOnly = sameHostBox->isChecked();
+    r.extensions = words(extensionsEdit->text());
+    r.mimeTypes = words(mimeEdit->text());
+    r.minSize = qint64(minSizeBox->value()) * 1024;
+    r.maxSize = qint64(maxSizeBox->value()) * 1024;
+    return r;
+}
+
+void LinkFilterDialog::onSave()
+{
+    const FilterRules r = rules();
+
+    LinkFilter probe;
+    const QStringList bad = probe.compile(r);
+    if (!bad.isEmpty()) {
+        QMessageBox::warning(this, "Link filter", "Invalid pattern(s):\n" + bad.join('\n'));
+        return;
+    }
+
+    r.save(settings, profile());
+    accept();
+}
@@ -0,0 +1,45 @@
+#ifndef LINKFILTERDIALOG_H
+#define LINKFILTERDIALOG_H
+
+
+#include <QDialog>
+
+#include "linkfilter.h"
+
+class QCheckBox;
+class QComboBox;
+class QLineEdit;
+class QPlainTextEdit;
+class QSpinBox;
+
+// Edits the filter profiles kept in settings; the chosen profile becomes the active one.
+class LinkFilterDialog : public QDialog {
+    Q_OBJECT
+public:
+    LinkFilterDialog(QSettings& settings, const QString& activeProfile, QWidget* parent = nullptr);
+
+    QString profile() const;
+
+private slots:
+    void onProfileChanged(const QString& name);
+    void onSave();
+
+private:
+    void showRules(const FilterRules& r);
+    FilterRules rules() const;
+
+    QSettings& settings;
+
+    QComboBox* profileBox = nullptr;
+    QPlainTextEdit* includeEdit = nullptr;
+    QPlainTextEdit* excludeEdit = nullptr;
+    QLineEdit* allowHostsEdit = nullptr;
+    QLineEdit* denyHostsEdit = nullptr;
+    QCheckBox* sameHostBox = nullptr;
+    QLineEdit* extensionsEdit = nullptr;
+    QLineEdit* mimeEdit = nullptr;
+    QSpinBox* minSizeBox = nullptr;
+    QSpinBox* maxSizeBox = nullptr;
+};
+
+#endif
@@ -1,9 +1,95 @@
 #include "mainwindow.h"
+#include "dbmanager.h"
+#include "queueworker.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QStandardPaths>
+#include <QUrl>
+#include <cstring>
+
+// Headless modes for the shared queue (no display needed):
+//   multi_downloader --worker  --db jobs.db [--dir out] [--id name] [--concurrency 8] [--lease 60]
+//   multi_downloader --enqueue --db jobs.db --dir out URL...
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"worker", "Claim and download jobs from the shared queue."});
+    parser.addOption({"enqueue", "Publish the given URLs as shared jobs and exit."});
+    parser.addOption({"db", "SQLite database shared by all workers.", "path"});
+    parser.addOption({"dir", "Download directory.", "path"});
+    parser.addOption({"id", "Worker id used for leases (default host:pid).", "name"});
+    parser.addOption({"concurrency", "Parallel downloads.", "n", "8"});
+    parser.addOption({"lease", "Lease length in seconds.", "secs", "60"});
+    parser.addOption({"exit-when-idle", "Exit once no shared job is left unfinished."});
+    parser.addOption({"no-wal", "Rollback journal, for a DB on a network filesystem."});
+    parser.addPositionalArgument("urls", "URLs to enqueue.", "[urls...]");
+    parser.process(app);
+
+    QString dbPath = parser.value("db");
+    if (dbPath.isEmpty())
+        dbPath = QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("scraper.db");
+    QDir().mkpath(QFileInfo(dbPath).absolutePath());
+
+    QString dir = parser.value("dir");
+    if (dir.isEmpty())
+        dir = QStandardPaths::writableLocation(QStandardPaths::DownloadLocation);
+
+    if (parser.isSet("enqueue")) {
+        DBManager db;
+        const bool rollbackJournal = parser.isSet("no-wal");
+        if (!db.openAtPath(dbPath, rollbackJournal)) {
+            qCritical().noquote() << "cannot open" << dbPath
+                                  << (rollbackJournal ? "with a rollback journal" : "in WAL mode");
+            return 1;
+        }
+
+        QDir().mkpath(dir);
+        int published = 0;
+        db.beginBatch();
+        for (const QString& u : parser.positionalArguments()) {
+            const QUrl url(u);
+            QString name = QFileInfo(url.path()).fileName();
+            if (!url.isValid() || name.isEmpty()) continue;
+            if (db.publishJob(url.toString(), QDir(dir).filePath(name), name))
+                ++published;
+        }
+        db.commitBatch();
+        qInfo().noquote() << "published" << published << "jobs to" << dbPath;
+        return 0;
+    }
+
+    QueueWorker::Options opt;
+    opt.dbPath = dbPath;
+    opt.downloadDir = dir;
+    opt.workerId = parser.value("id");
+    opt.concurrency = qMax(1, parser.value("concurrency").toInt());
+    opt.leaseSecs = qMax(5, parser.value("lease").toInt());
+    opt.exitWhenIdle = parser.isSet("exit-when-idle");
+    opt.rollbackJournal = parser.isSet("no-wal");
+
+    QueueWorker worker(opt);
+    QObject::connect(&worker, &QueueWorker::idle, &app, &QCoreApplication::quit);
+
+    QString error;
+    if (!worker.start(&error)) {
+        qCritical().noquote() << error;
+        return 1;
+    }
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; ++i)
+        if (!std::strcmp(argv[i], "--worker") || !std::strcmp(argv[i], "--enqueue"))
+            return runHeadless(argc, argv);
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -1,32 +1,37 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "packfile.h"
+#include "tracer.h"
+#include "linkfilterdialog.h"
+#include "queueworker.h"
+#include "urlhelpers.h"
 
 #include <QFileDialog>
 #include <QStandardPaths>
 #include <QDir>
 #include <QUrl>
+#include <QFile>
 #include <QFileInfo>
 #include <QHeaderView>
 #include <QRegularExpression>
 #include <QSet>
 #include <QTabWidget>
+#include <QAction>
+#include <QMenu>
+#include <QMenuBar>
+#include <QMessageBox>
+#include <QSettings>
+#include <QInputDialog>
+#include <QDateTime>
+#include <utility>
 
 
-static bool hasAllowedExtension(const QUrl& u)
+static QSettings& appSettings()
 {
-    const QString path = u.path().toLower();
-
-    static const QStringList exts = {
-        ".png",".jpg",".jpeg",".webp",".gif",".svg",".ico",
-        ".pdf",".zip",".rar",".7z",
-        ".bin",".hex",".txt",".csv",".json",".xml",
-        ".mp4",".mp3",".wav"
-    };
-
-    for (const auto& e : exts)
-        if (path.endsWith(e)) return true;
-
-    return false;
+    static QSettings settings(
+        QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath("settings.ini"),
+        QSettings::IniFormat);
+    return settings;
 }
 
 
@@ -37,8 +42,13 @@ MainWindow::MainWindow(QWidget *parent)
     ui->setupUi(this);
 
 
-    if (!db.openDefault()) {
-        ui->statusbar->showMessage("DB error: cannot open SQLite database (check QT += sql / Qt::Sql)", 6000);
+    // DB on a network share used from several machines: every instance needs the same mode
+    rollbackJournal = appSettings().value("queue/rollbackJournal", false).toBool();
+    if (!db.openDefault(rollbackJournal)) {
+        QMessageBox::warning(this, "Database",
+                             QString("Cannot open the SQLite database %1 (check QT += sql / Qt::Sql, "
+                                     "and that every instance uses the same queue/rollbackJournal).")
+                                 .arg(rollbackJournal ? "with a rollback journal" : "in WAL mode"));
     }
     qDebug() << "DB path =" << QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
                                    .filePath("scraper.db");
@@ -52,10 +62,12 @@ MainWindow::MainWindow(QWidget *parent)
     ui->tableWidget->horizontalHeader()->setSectionResizeMode(COL_STATUS, QHeaderView::ResizeToContents);
 
 
-    ui->tableWidget_2->setColumnCount(2);
-    ui->tableWidget_2->setHorizontalHeaderLabels({"URL", "File"});
+    ui->tableWidget_2->setColumnCount(4);
+    ui->tableWidget_2->setHorizontalHeaderLabels({"URL", "File", "Progress", "Status"});
     ui->tableWidget_2->horizontalHeader()->setSectionResizeMode(COL_URL, QHeaderView::Stretch);
     ui->tableWidget_2->horizontalHeader()->setSectionResizeMode(COL_FILE, QHeaderView::ResizeToContents);
+    ui->tableWidget_2->horizontalHeader()->setSectionResizeMode(COL_PROGRESS, QHeaderView::ResizeToContents);
+    ui->tableWidget_2->horizontalHeader()->setSectionResizeMode(COL_STATUS, QHeaderView::ResizeToContents);
 
 
     ui->startButton->setEnabled(false);
@@ -72,20 +84,119 @@ MainWindow::MainWindow(QWidget *parent)
             this, &MainWindow::on_tableWidget_2_cellDoubleClicked);
 
 
+    QMenu* optionsMenu = ui->menubar->addMenu("options");
+    packAction = optionsMenu->addAction("pack small files into tar packs");
+    packAction->setCheckable(true);
+    packAction->setChecked(appSettings().value("pack/enabled", false).toBool());
+    connect(packAction, &QAction::toggled, this, &MainWindow::onPackModeToggled);
+
+    skipUnchangedAction = optionsMenu->addAction("sitemaps: skip items unchanged since last download");
+    skipUnchangedAction->setCheckable(true);
+    skipUnchangedAction->setChecked(appSettings().value("sitemap/skipUnchanged", true).toBool());
+    connect(skipUnchangedAction, &QAction::toggled, this,
+            [](bool on) { appSettings().setValue("sitemap/skipUnchanged", on); });
+
+    treeAction = optionsMenu->addAction("tree hash: parallel chunk digests, verified resume");
+    treeAction->setCheckable(true);
+    treeAction->setChecked(appSettings().value("tree/enabled", false).toBool());
+    connect(treeAction, &QAction::toggled, this, &MainWindow::onTreeModeToggled);
+
+    extractAction = optionsMenu->addAction("post-process: extract .gz / .zip / .tar downloads");
+    extractAction->setCheckable(true);
+    extractAction->setChecked(appSettings().value("post/extract", false).toBool());
+    connect(extractAction, &QAction::toggled, this, [this](bool on) {
+        appSettings().setValue("post/extract", on);
+        configurePostProcessing();
+    });
+
+    sharedAction = optionsMenu->addAction("shared queue: let other instances take jobs");
+    sharedAction->setCheckable(true);
+    sharedAction->setChecked(appSettings().value("queue/shared", false).toBool());
+    connect(sharedAction, &QAction::toggled, this,
+            [](bool on) { appSettings().setValue("queue/shared", on); });
+
+    retentionAction = optionsMenu->addAction("retention: archive old history in the background");
+    retentionAction->setCheckable(true);
+    retentionAction->setChecked(appSettings().value("retention/enabled", false).toBool());
+    connect(retentionAction, &QAction::toggled, this, [this](bool on) {
+        appSettings().setValue("retention/enabled", on);
+        applyRetention();
+    });
+
+    QAction* traceAction = optionsMenu->addAction("record lifecycle trace");
+    traceAction->setCheckable(true);
+    traceAction->setChecked(appSettings().value("trace/enabled", false).toBool());
+    Trace::setEnabled(traceAction->isChecked());
+    connect(traceAction, &QAction::toggled, this, [](bool on) {
+        appSettings().setValue("trace/enabled", on);
+        if (on)
+            Trace::clear();   // each recording starts empty
+        Trace::setEnabled(on);
+    });
+
+    QMenu* toolsMenu = ui->menubar->addMenu("tools");
+    connect(toolsMenu->addAction("export trace (Chrome/Perfetto JSON)..."), &QAction::triggered,
+            this, &MainWindow::onExportTraceClicked);
+    connect(toolsMenu->addAction("discover from robots.txt / sitemaps"), &QAction::triggered,
+            this, &MainWindow::onDiscoverSitemapsClicked);
+    connect(toolsMenu->addAction("extract pack..."), &QAction::triggered,
+            this, &MainWindow::onExtractPackClicked);
+    connect(toolsMenu->addAction("post-process command..."), &QAction::triggered,
+            this, &MainWindow::onPostCommandClicked);
+    connect(toolsMenu->addAction("link filter..."), &QAction::triggered,
+            this, &MainWindow::onEditFilterClicked);
+    connect(toolsMenu->addAction("database: run retention now"), &QAction::triggered, this, [this]() {
+        applyRetention();
+        emit requestRetentionRun();
+    });
+    connect(toolsMenu->addAction("database: compact (full vacuum)"), &QAction::triggered, this, [this]() {
+        ui->statusbar->showMessage("compacting database...");
+        emit requestCompact();
+    });
+    connect(toolsMenu->addAction("database: stats"), &QAction::triggered,
+            this, &MainWindow::requestDbStats);
+
+    loadLinkFilter(appSettings().value("filters/active", "default").toString());
+
+
+    warmer = new ConnectionWarmer(&net, this);
+
+    sitemaps = new SitemapCrawler(&net, this);
+    sitemaps->maxUrls = appSettings().value("sitemap/maxUrls", 20000).toLongLong();
+    connect(sitemaps, &SitemapCrawler::urlsFound, this, &MainWindow::onSitemapUrls);
+    connect(sitemaps, &SitemapCrawler::finished,  this, &MainWindow::onSitemapFinished);
+    connect(sitemaps, &SitemapCrawler::progress,  this,
+            [this](const QString& msg) { ui->statusbar->showMessage(msg, 3000); });
+
+
+    qRegisterMetaType<QVector<QByteArray>>("QVector<QByteArray>");
+
+    writerThread.setObjectName("writer");
     writer = new FileWriterWorker();
     writer->moveToThread(&writerThread);
 
     connect(&writerThread, &QThread::finished, writer, &QObject::deleteLater);
 
     connect(this, &MainWindow::requestOpenFile,    writer, &FileWriterWorker::openFile,    Qt::QueuedConnection);
+    connect(this, &MainWindow::requestOpenFileAt,  writer, &FileWriterWorker::openFileAt,  Qt::QueuedConnection);
     connect(this, &MainWindow::requestAppendChunk, writer, &FileWriterWorker::appendChunk, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestWriteAt,     writer, &FileWriterWorker::writeAt,     Qt::QueuedConnection);
     connect(this, &MainWindow::requestCloseFile,   writer, &FileWriterWorker::closeFile,   Qt::QueuedConnection);
+    connect(this, &MainWindow::requestAbortFile,   writer, &FileWriterWorker::abortFile,   Qt::QueuedConnection);
+    connect(this, &MainWindow::requestDiscardFile, writer, &FileWriterWorker::discardFile, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestPackMode,    writer, &FileWriterWorker::setPackMode, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestTreeChunkSize, writer, &FileWriterWorker::setTreeChunkSize, Qt::QueuedConnection);
 
     connect(writer, &FileWriterWorker::writeError, this, &MainWindow::onWriterError, Qt::QueuedConnection);
+    connect(writer, &FileWriterWorker::fileClosed, this, &MainWindow::onFileClosed,  Qt::QueuedConnection);
+    connect(writer, &FileWriterWorker::filePacked, this, &MainWindow::onFilePacked,  Qt::QueuedConnection);
+    connect(writer, &FileWriterWorker::chunkHashed, this, &MainWindow::onChunkHashed, Qt::QueuedConnection);
 
+    applyTreeMode();
     writerThread.start();
 
 
+    hashThread.setObjectName("hasher");
     hasher = new HasherWorker();
     hasher->moveToThread(&hashThread);
 
@@ -95,11 +206,90 @@ MainWindow::MainWindow(QWidget *parent)
     connect(hasher, &HasherWorker::hashReady, this, &MainWindow::onHashReady, Qt::QueuedConnection);
     connect(hasher, &HasherWorker::hashError, this, &MainWindow::onHashError, Qt::QueuedConnection);
 
+    connect(this, &MainWindow::requestTreeHash,     hasher, &HasherWorker::hashFileTree, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestVerifyChunks, hasher, &HasherWorker::verifyChunks, Qt::QueuedConnection);
+    connect(hasher, &HasherWorker::treeHashReady,  this, &MainWindow::onTreeHashReady,  Qt::QueuedConnection);
+    connect(hasher, &HasherWorker::chunksVerified, this, &MainWindow::onChunksVerified, Qt::QueuedConnection);
+
     hashThread.start();
+
+
+    qRegisterMetaType<StageReport>("StageReport");
+
+    post = new PostProcessor(this);
+    post->setMaxThreads(appSettings().value("post/threads", qMax(1, QThread::idealThreadCount() / 2)).toInt());
+    connect(post, &PostProcessor::stageFinished, this, &MainWindow::onStageFinished);
+    connect(post, &PostProcessor::finished,      this, &MainWindow::onPostFinished);
+    configurePostProcessing();
+
+    extractThread.setObjectName("extract");
+    extractor = new StreamExtractWorker();
+    extractor->moveToThread(&extractThread);
+
+    connect(&extractThread, &QThread::finished, extractor, &QObject::deleteLater);
+
+    connect(this, &MainWindow::requestStreamBegin, extractor, &StreamExtractWorker::begin, Qt::QueuedConnection);
+    connect(this, &MainWindow::requestStreamFeed,  extractor, &StreamExtractWorker::feed,  Qt::QueuedConnection);
+    connect(this, &MainWindow::requestStreamEnd,   extractor, &StreamExtractWorker::end,   Qt::QueuedConnection);
+    connect(this, &MainWindow::requestStreamAbort, extractor, &StreamExtractWorker::abort, Qt::QueuedConnection);
+    connect(extractor, &StreamExtractWorker::streamFinished, this, &MainWindow::onStreamFinished, Qt::QueuedConnection);
+
+    extractThread.start();
+
+
+    qRegisterMetaType<RetentionPolicy>("RetentionPolicy");
+    qRegisterMetaType<DbStats>("DbStats");
+
+    retentionThread.setObjectName("retention");
+    retention = new RetentionWorker();
+    retention->moveToThread(&retentionThread);
+
+    connect(&retentionThread, &QThread::finished, retention, &QObject::deleteLater);
+
+    connect(this, &MainWindow::requestRetentionOpen,   retention, &RetentionWorker::open,         Qt::QueuedConnection);
+    connect(this, &MainWindow::requestRetentionPolicy, retention, &RetentionWorker::setPolicy,    Qt::QueuedConnection);
+    connect(this, &MainWindow::requestRetentionRun,    retention, &RetentionWorker::runNow,       Qt::QueuedConnection);
+    connect(this, &MainWindow::requestCompact,         retention, &RetentionWorker::compactNow,   Qt::QueuedConnection);
+    connect(this, &MainWindow::requestDbStats,         retention, &RetentionWorker::refreshStats, Qt::QueuedConnection);
+    connect(retention, &RetentionWorker::report, this, &MainWindow::onRetentionReport, Qt::QueuedConnection);
+    connect(retention, &RetentionWorker::failed, this,
+            [this](const QString& msg) { ui->statusbar->showMessage(msg, 6000); }, Qt::QueuedConnection);
+
+    retentionThread.start();
+    emit requestRetentionOpen(db.path(), rollbackJournal);   // mode settled by openDefault above
+    applyRetention();
+
+
+    uiFrameTimer.setSingleShot(true);
+    uiFrameTimer.setInterval(50);   // ~20 Hz
+    connect(&uiFrameTimer, &QTimer::timeout, this, &MainWindow::flushUi);
+
+    historyTimer.setSingleShot(true);
+    historyTimer.setInterval(500);
+    connect(&historyTimer, &QTimer::timeout, this, &MainWindow::refreshHistory);
+
+
+    watchdogTimer.setInterval(1000);
+    connect(&watchdogTimer, &QTimer::timeout, this, &MainWindow::onWatchdogTick);
+    watchdogTimer.start();
+
+
+    workerId = "gui@" + QueueWorker::defaultWorkerId();
+    sharedLeaseSecs = qMax(5, appSettings().value("queue/leaseSecs", 60).toInt());
+
+    sharedTimer.setInterval(1000);
+    connect(&sharedTimer, &QTimer::timeout, this, &MainWindow::onSharedTick);
+    sharedTimer.start();
 }
 
 MainWindow::~MainWindow()
 {
+    flushUi();
+
+    // hand unfinished shared jobs straight to the other workers instead of waiting out the lease
+    for (auto it = claimedPath.cbegin(); it != claimedPath.cend(); ++it)
+        db.releaseLease(jobs.url(it.key()), it.value(), workerId);
+
     if (pageReply) {
         pageReply->abort();
         pageReply->deleteLater();
@@ -112,15 +302,13 @@ MainWindow::~MainWindow()
     hashThread.quit();
     hashThread.wait();
 
-    delete ui;
-}
+    extractThread.quit();
+    extractThread.wait();
 
-QString MainWindow::fileNameFromUrl(const QString& urlStr) const
-{
-    QUrl url(urlStr);
-    QString name = QFileInfo(url.path()).fileName();
-    if (name.isEmpty()) name = "download.bin";
-    return name;
+    retentionThread.quit();
+    retentionThread.wait();
+
+    delete ui;
 }
 
 void MainWindow::ensureRowCells(int row)
@@ -136,53 +324,134 @@ void MainWindow::ensureRowCells(int row)
     ensure(COL_STATUS, "Queued");
 }
 
-void MainWindow::setProgress(int row, int percent)
+void MainWindow::setProgress(int job, int percent)
 {
-    ensureRowCells(row);
-    ui->tableWidget->item(row, COL_PROGRESS)->setText(QString::number(percent) + "%");
+    jobs.setProgress(job, percent);
+    dirtyJobs[job] |= DIRTY_PROGRESS;
+    if (!uiFrameTimer.isActive()) uiFrameTimer.start();
 }
 
-void MainWindow::setStatus(int row, const QString& status)
+void MainWindow::setStatus(int job, const QString& status)
 {
-    ensureRowCells(row);
-    ui->tableWidget->item(row, COL_STATUS)->setText(status);
+    jobs.setStatus(job, status);
+    dirtyJobs[job] |= DIRTY_STATUS;
+    if (!uiFrameTimer.isActive()) uiFrameTimer.start();
 }
 
-bool MainWindow::urlExistsInTable(const QString& urlStr) const
+void MainWindow::queueDbProgress(int job)
+{
+    dirtyDbProgress.insert(job);
+    if (!uiFrameTimer.isActive()) uiFrameTimer.start();
+}
+
+void MainWindow::flushUi()
 {
-    for (int r = 0; r < ui->tableWidget->rowCount(); ++r) {
-        auto *it = ui->tableWidget->item(r, COL_URL);
-        if (it && it->text().trimmed() == urlStr.trimmed())
-            return true;
+    if (!dirtyJobs.isEmpty()) {
+        QTableWidget* table = ui->tableWidget;
+        table->setUpdatesEnabled(false);
+
+        for (auto it = dirtyJobs.cbegin(); it != dirtyJobs.cend(); ++it) {
+            const int job = it.key();
+            const int row = jobs.row(job);
+            if (row < 0 || row >= table->rowCount()) continue;
+
+            ensureRowCells(row);
+            if (it.value() & DIRTY_PROGRESS)
+                table->item(row, COL_PROGRESS)->setText(QString::number(jobs.progress(job)) + "%");
+            if (it.value() & DIRTY_STATUS)
+                table->item(row, COL_STATUS)->setText(jobs.statusText(job));
+        }
+        dirtyJobs.clear();
+
+        table->setUpdatesEnabled(true);
     }
-    return false;
+
+    if (!dirtyDbProgress.isEmpty()) {
+        QVector<ProgressUpdate> batch;
+        batch.reserve(dirtyDbProgress.size());
+        for (int job : std::as_const(dirtyDbProgress)) {
+            ProgressUpdate u;
+            u.url = jobs.url(job);
+            u.filePath = jobs.path(job);
+            u.progress = jobs.progress(job);
+            u.owner = leaseOwner(job);
+            batch.push_back(u);
+        }
+        dirtyDbProgress.clear();
+
+        db.updateProgressBatch(batch);
+    }
+
+    if (!pendingPacked.isEmpty()) {
+        db.recordPackedBatch(pendingPacked);
+        // shared jobs: the lease goes only once Done is on record, or the job could be claimed again
+        for (const PackedEntry& e : std::as_const(pendingPacked))
+            if (packedShared.remove(e.url + '\n' + e.filePath))
+                db.releaseLease(e.url, e.filePath, workerId);
+        pendingPacked.clear();
+        scheduleHistoryRefresh();
+    }
+
+    flushChunkDigests();
+}
+
+void MainWindow::flushChunkDigests()
+{
+    if (pendingChunkDigests.isEmpty()) return;
+    db.recordChunkDigests(pendingChunkDigests);
+    pendingChunkDigests.clear();
 }
 
-void MainWindow::addUrlToTable(const QString& urlStr)
+bool MainWindow::urlExistsInTable(const QString& urlStr) const
 {
-    if (urlStr.trimmed().isEmpty()) return;
-    if (urlExistsInTable(urlStr)) return;
+    return jobs.find(urlStr.trimmed()) >= 0;
+}
+
+int MainWindow::addUrlToTable(const QString& urlStr)
+{
+    const QString url = urlStr.trimmed();
+    if (url.isEmpty()) return -1;
+
+    // DB: add queued record (temp path if folder not chosen yet)
+    const QString fileName = UrlHelpers::fileNameFromUrl(url);
+    const QString baseDir = downloadDir.isEmpty() ? QDir::tempPath() : downloadDir;
+    const QString fullPath = QDir(baseDir).filePath(fileName);
+
+    const int job = jobs.add(url, fullPath);
+    if (job < 0) return -1;
 
     const int row = ui->tableWidget->rowCount();
     ui->tableWidget->insertRow(row);
+    jobs.setRow(job, row);
 
-    const QString fileName = fileNameFromUrl(urlStr);
-
-    ui->tableWidget->setItem(row, COL_URL, new QTableWidgetItem(urlStr));
+    ui->tableWidget->setItem(row, COL_URL, new QTableWidgetItem(url));
     ui->tableWidget->setItem(row, COL_FILE, new QTableWidgetItem(fileName));
     ui->tableWidget->setItem(row, COL_PROGRESS, new QTableWidgetItem("0%"));
     ui->tableWidget->setItem(row, COL_STATUS, new QTableWidgetItem("Queued"));
 
-    // DB: add queued record (temp path if folder not chosen yet)
-    const QString baseDir = downloadDir.isEmpty() ? QDir::tempPath() : downloadDir;
-    const QString fullPath = QDir(baseDir).filePath(fileName);
+    db.addOrIgnoreQueued(url, fullPath, fileName);
+    db.updateStatus(url, fullPath, "Queued");
+    db.updateProgress(url, fullPath, 0);
 
-    rowToUrl[row] = urlStr;
-    rowToPath[row] = fullPath;
+    return job;
+}
 
-    db.addOrIgnoreQueued(urlStr, fullPath, fileName);
-    db.updateStatus(urlStr, fullPath, "Queued");
-    db.updateProgress(urlStr, fullPath, 0);
+void MainWindow::applyMirrors(int job, const QStringList& urls, const QString& expectedSha)
+{
+    if (job < 0) return;
+
+    if (urls.size() > 1) {
+        jobMirrors[job] = urls;
+        db.setMirrors(urls.first(), urls);
+        ui->tableWidget->item(jobs.row(job), COL_URL)->setToolTip("Mirrors:\n" + urls.join("\n"));
+    }
+
+    // explicit sha256= wins; otherwise a mirror set is checked against the last recorded digest
+    QString sha = expectedSha;
+    if (sha.isEmpty() && urls.size() > 1)
+        sha = db.recordedSha256(urls.first());
+    if (!sha.isEmpty())
+        jobExpectedSha[job] = sha.toLower();
 }
 
 void MainWindow::onChooseFolderClicked()
@@ -197,63 +466,105 @@ void MainWindow::onChooseFolderClicked()
     ui->statusbar->showMessage("Folder selected: " + dir, 2500);
 
     ui->startButton->setEnabled(true);
+    applyPackMode();
 }
 
-bool MainWindow::looksLikeWebPage(const QUrl& u) const
+qint64 MainWindow::packThreshold() const
 {
-    QString path = u.path();
-    if (path.isEmpty() || path.endsWith('/')) return true;
+    if (!packAction->isChecked() || downloadDir.isEmpty()) return 0;
+    return appSettings().value("pack/thresholdKB", 256).toLongLong() * 1024;
+}
 
-    QString lower = path.toLower();
-    if (lower.endsWith(".html") || lower.endsWith(".htm")) return true;
+void MainWindow::applyPackMode()
+{
+    const qint64 threshold = packThreshold();
+    emit requestPackMode(threshold > 0, QDir(downloadDir).filePath("packs"), threshold);
+}
 
-    QString ext = QFileInfo(path).suffix().toLower();
-    if (ext.isEmpty()) return true;
+void MainWindow::onPackModeToggled(bool enabled)
+{
+    appSettings().setValue("pack/enabled", enabled);
+    applyPackMode();
+}
 
-    return false;
+qint64 MainWindow::treeChunkSize() const
+{
+    if (!treeAction->isChecked()) return 0;
+    return qMax<qint64>(64, appSettings().value("tree/chunkKB", 4096).toLongLong()) * 1024;
 }
 
-QList<QUrl> MainWindow::extractLinksFromHtml(const QString& html, const QUrl& baseUrl)
+void MainWindow::applyTreeMode()
 {
-    QList<QUrl> out;
-    QSet<QString> seen;
+    emit requestTreeChunkSize(treeChunkSize());
+}
 
-    QRegularExpression re(
-        R"((?:href|src)\s*=\s*["']([^"'#]+)["'])",
-        QRegularExpression::CaseInsensitiveOption
-        );
+void MainWindow::onTreeModeToggled(bool enabled)
+{
+    appSettings().setValue("tree/enabled", enabled);
+    applyTreeMode();
+}
 
-    auto it = re.globalMatch(html);
-    while (it.hasNext()) {
-        auto m = it.next();
-        const QString raw = m.captured(1).trimmed();
-        if (raw.isEmpty()) continue;
+void MainWindow::onExportTraceClicked()
+{
+    const QString path = QFileDialog::getSaveFileName(this, "Export trace", "trace.json", "Trace (*.json)");
+    if (path.isEmpty()) return;
 
-        QUrl resolved = baseUrl.resolved(QUrl(raw));
-        if (!resolved.isValid()) continue;
+    QString error;
+    if (!Trace::writeChromeJson(path, &error)) {
+        QMessageBox::warning(this, "Export trace", error);
+        return;
+    }
+    ui->statusbar->showMessage("Trace written: " + path + " (open in ui.perfetto.dev)", 4000);
+}
 
-        if (resolved.scheme() != "http" && resolved.scheme() != "https") continue;
+void MainWindow::onExtractPackClicked()
+{
+    const QString startDir = downloadDir.isEmpty() ? QString() : QDir(downloadDir).filePath("packs");
+    const QString pack = QFileDialog::getOpenFileName(this, "Choose pack", startDir, "Packs (*.tar)");
+    if (pack.isEmpty()) return;
 
-        const QString key = resolved.toString(QUrl::FullyDecoded);
-        if (seen.contains(key)) continue;
-        seen.insert(key);
+    const QString dest = QFileDialog::getExistingDirectory(this, "Extract into", downloadDir);
+    if (dest.isEmpty()) return;
 
-        out.push_back(resolved);
+    QString error;
+    const int n = PackWriter::extract(pack, dest, &error);
+    if (n < 0) {
+        QMessageBox::warning(this, "Extract pack", error);
+        return;
     }
-    return out;
+    ui->statusbar->showMessage(QString("Extracted %1 file(s) into %2").arg(n).arg(dest), 4000);
+}
+
+bool MainWindow::looksLikeWebPage(const QUrl& u) const
+{
+    QString path = u.path();
+    if (path.isEmpty() || path.endsWith('/')) return true;
+
+    QString lower = path.toLower();
+    if (lower.endsWith(".html") || lower.endsWith(".htm")) return true;
+
+    QString ext = QFileInfo(path).suffix().toLower();
+    if (ext.isEmpty()) return true;
+
+    return false;
 }
 
-bool MainWindow::allowedByFilter(const QUrl& u, const QUrl& baseUrl) const
+void MainWindow::loadLinkFilter(const QString& profile)
 {
-    // Same host only (optional)
-    if (!u.host().isEmpty() && u.host() != baseUrl.host())
-        return false;
+    filterProfile = profile;
+    const QStringList bad = linkFilter.compile(FilterRules::load(appSettings(), profile));
+    if (!bad.isEmpty())
+        ui->statusbar->showMessage("Link filter: ignored invalid pattern(s): " + bad.join(", "), 6000);
+}
 
-    // Only file-like extensions
-    if (!hasAllowedExtension(u))
-        return false;
+void MainWindow::onEditFilterClicked()
+{
+    LinkFilterDialog dlg(appSettings(), filterProfile, this);
+    if (dlg.exec() != QDialog::Accepted) return;
 
-    return true;
+    appSettings().setValue("filters/active", dlg.profile());
+    loadLinkFilter(dlg.profile());
+    ui->statusbar->showMessage("Link filter profile: " + filterProfile, 2500);
 }
 
 void MainWindow::onAddClicked()
@@ -264,9 +575,42 @@ void MainWindow::onAddClicked()
         return;
     }
 
-    QUrl url(input);
-    if (!url.isValid() || url.scheme().isEmpty()) {
-        ui->statusbar->showMessage("Invalid URL. Include http/https.", 2500);
+    // Several URLs (space or '|' separated) are mirrors of one file; "sha256=<hex>" pins its digest
+    static const QRegularExpression sep(R"([\s|]+)");
+    QStringList urls;
+    QString expectedSha;
+    for (const QString& token : input.split(sep, Qt::SkipEmptyParts)) {
+        if (token.startsWith("sha256=", Qt::CaseInsensitive))
+            expectedSha = token.mid(7);
+        else
+            urls << token;
+    }
+
+    if (urls.isEmpty()) {
+        ui->statusbar->showMessage("Paste a URL first.", 2000);
+        return;
+    }
+
+    for (const QString& u : urls) {
+        const QUrl parsed(u);
+        if (!parsed.isValid() || parsed.scheme().isEmpty()) {
+            ui->statusbar->showMessage("Invalid URL. Include http/https.", 2500);
+            return;
+        }
+    }
+
+    if (urls.size() > 1 || !expectedSha.isEmpty()) {
+        applyMirrors(addUrlToTable(urls.first()), urls, expectedSha);
+        ui->lineEdit->clear();
+        return;
+    }
+
+    QUrl url(urls.first());
+
+    // robots.txt / sitemap URLs → stream the sitemaps and enqueue what matches the filter
+    if (looksLikeSitemapSource(url)) {
+        startSitemapDiscovery(url);
+        ui->lineEdit->clear();
         return;
     }
 
@@ -280,7 +624,9 @@ void MainWindow::onAddClicked()
         pageBaseUrl = url;
         ui->statusbar->showMessage("Fetching page HTML...", 2000);
 
-        pageReply = net.get(QNetworkRequest(url));
+        QNetworkRequest req(url);
+        warmer->prepare(req);
+        pageReply = net.get(req);
         connect(pageReply, &QNetworkReply::finished, this, &MainWindow::onPageFetched);
 
         ui->lineEdit->clear();
@@ -310,18 +656,19 @@ void MainWindow::onPageFetched()
 
     const QString html = QString::fromUtf8(data);
 
-    QList<QUrl> links = extractLinksFromHtml(html, pageBaseUrl);
+    const QList<QUrl> links = UrlHelpers::extractLinksFromHtml(html, pageBaseUrl);
+    const QVector<bool> wanted = linkFilter.evaluate(links, pageBaseUrl);
 
     const int MAX_FILES = 200;
     int added = 0;
 
-    for (const QUrl& u : links) {
+    for (int i = 0; i < links.size(); ++i) {
         if (added >= MAX_FILES) break;
 
-        if (!allowedByFilter(u, pageBaseUrl))
+        if (!wanted[i])
             continue;
 
-        const QString urlStr = u.toString();
+        const QString urlStr = links[i].toString();
         if (urlExistsInTable(urlStr))
             continue;
 
@@ -335,6 +682,87 @@ void MainWindow::onPageFetched()
         );
 }
 
+// -------------------- Sitemap discovery --------------------
+bool MainWindow::looksLikeSitemapSource(const QUrl& u)
+{
+    const QString path = u.path().toLower();
+    if (path.endsWith("/robots.txt")) return true;
+    return path.contains("sitemap") && (path.endsWith(".xml") || path.endsWith(".xml.gz"));
+}
+
+void MainWindow::onDiscoverSitemapsClicked()
+{
+    const QUrl url(ui->lineEdit->text().trimmed());
+    if (!url.isValid() || url.host().isEmpty()) {
+        ui->statusbar->showMessage("Paste the site URL first.", 2500);
+        return;
+    }
+    startSitemapDiscovery(url);
+    ui->lineEdit->clear();
+}
+
+void MainWindow::startSitemapDiscovery(const QUrl& u)
+{
+    if (sitemaps->isRunning()) {
+        ui->statusbar->showMessage("Sitemap discovery already running.", 2500);
+        return;
+    }
+
+    sitemapBaseUrl = u;
+    sitemapAdded = 0;
+    sitemapSkipped = 0;
+    sitemapDoneTimes = skipUnchangedAction->isChecked() ? db.completedAt() : QHash<QString, QString>();
+
+    sitemaps->start(u);
+}
+
+void MainWindow::onSitemapUrls(const QList<SitemapEntry>& entries)
+{
+    ui->tableWidget->setUpdatesEnabled(false);
+    db.beginBatch();
+
+    QList<QUrl> urls;
+    urls.reserve(entries.size());
+    for (const SitemapEntry& e : entries)
+        urls << e.url;
+    const QVector<bool> wanted = linkFilter.evaluate(urls, sitemapBaseUrl);
+
+    for (int i = 0; i < entries.size(); ++i) {
+        const SitemapEntry& e = entries[i];
+        if (!wanted[i])
+            continue;
+
+        const QString urlStr = e.url.toString();
+        if (urlExistsInTable(urlStr))
+            continue;
+
+        // <lastmod> not newer than our last completed download: nothing to fetch
+        if (e.lastModified.isValid()) {
+            const QString done = sitemapDoneTimes.value(urlStr);
+            if (!done.isEmpty() && QDateTime::fromString(done, Qt::ISODate) >= e.lastModified) {
+                sitemapSkipped++;
+                continue;
+            }
+        }
+
+        addUrlToTable(urlStr);
+        sitemapAdded++;
+    }
+
+    db.commitBatch();
+    ui->tableWidget->setUpdatesEnabled(true);
+}
+
+void MainWindow::onSitemapFinished(qint64 urls, int sitemapCount, const QString& error)
+{
+    sitemapDoneTimes.clear();
+
+    QString msg = QString("Sitemaps: %1 read, %2 URL(s) listed, %3 added, %4 unchanged skipped.")
+                      .arg(sitemapCount).arg(urls).arg(sitemapAdded).arg(sitemapSkipped);
+    if (!error.isEmpty()) msg += " " + error;
+    ui->statusbar->showMessage(msg, 6000);
+}
+
 void MainWindow::onStartAllClicked()
 {
     if (downloadDir.isEmpty()) {
@@ -342,63 +770,473 @@ void MainWindow::onStartAllClicked()
         return;
     }
 
-    const int rows = ui->tableWidget->rowCount();
-    if (rows == 0) {
+    if (jobs.size() == 0) {
         ui->statusbar->showMessage("Add at least one URL.", 2500);
         return;
     }
 
-    for (int row = 0; row < rows; ++row) {
-        ensureRowCells(row);
-        const QString status = ui->tableWidget->item(row, COL_STATUS)->text();
+    // a new batch: hosts are pre-warmed again and the report starts from zero
+    if (pendingJobs.isEmpty() && replyToJob.isEmpty() && jobToMirror.isEmpty())
+        warmer->resetStats();
+
+    const bool shared = sharedAction->isChecked();
+    if (shared) {
+        db.beginBatch();
+        if (sharedStamp.isEmpty())
+            sharedStamp = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    }
 
-        if (status == "Downloading" || status.startsWith("Done") || status.startsWith("Error"))
+    int queued = 0;
+    for (int job = 0; job < jobs.size(); ++job) {
+        if (jobs.phase(job) != JobStore::Phase::Queued)
             continue;
 
-        startDownloadForRow(row);
+        // published only: whichever instance has a free slot first claims it
+        if (shared) {
+            const QString urlStr = jobs.url(job);
+            const QString fileName = UrlHelpers::fileNameFromUrl(urlStr);
+            const QString path = QDir(downloadDir).filePath(fileName);
+            if (db.publishJob(urlStr, path, fileName)) {
+                sharedJobs.insert(urlStr + '\n' + path, job);
+                setStatus(job, "Queued (shared)");
+                queued++;
+            }
+            continue;
+        }
+
+        jobAttempts.remove(job);
+        enqueueJob(job);
+        queued++;
     }
 
-    ui->statusbar->showMessage("Started downloads.", 2000);
+    if (shared) {
+        db.commitBatch();
+        onSharedTick();
+        ui->statusbar->showMessage(QString("Published %1 job(s) to the shared queue.").arg(queued), 2000);
+        return;
+    }
+
+    // resolve + connect (TLS included) to the queued hosts while the first transfers start
+    QList<QUrl> hosts;
+    for (int job : std::as_const(pendingJobs))
+        hosts << QUrl(jobs.url(job));
+    warmer->prewarm(hosts);
+
+    pumpQueue();
+
+    ui->statusbar->showMessage(QString("Started downloads (%1 queued).").arg(queued), 2000);
 }
 
 // -------------------- Download logic --------------------
-void MainWindow::startDownloadForRow(int row)
+void MainWindow::enqueueJob(int job)
+{
+    lostLeases.remove(job);   // claimed again, or restarted by hand
+    Trace::asyncBegin("queue", "queued", job);
+    setStatus(job, "Waiting");
+    pendingJobs.enqueue(job);
+}
+
+void MainWindow::pumpQueue()
+{
+    // Start whatever the per-host windows allow; jobs for saturated hosts keep their place.
+    QQueue<int> blocked;
+    while (!pendingJobs.isEmpty()) {
+        const int job = pendingJobs.dequeue();
+        if (!jobs.contains(job))
+            continue;
+
+        const QString& host = jobs.host(job);
+        if (host.isEmpty()) {
+            setStatus(job, "Error: invalid URL");
+            continue;
+        }
+
+        if (!hostLimiter.tryAcquire(host)) {
+            blocked.enqueue(job);
+            if (hostLimiter.totalActive() >= hostLimiter.maxTotal)
+                break;
+            continue;
+        }
+
+        startDownload(job);
+    }
+
+    // keep FIFO order: blocked jobs go back in front of anything not yet visited
+    while (!pendingJobs.isEmpty())
+        blocked.enqueue(pendingJobs.dequeue());
+    pendingJobs = blocked;
+}
+
+void MainWindow::scheduleRetry(int job, int delayMs, const QString& reason)
+{
+    const int attempt = jobAttempts.value(job);
+    const QString status = QString("Retrying in %1s (%2/%3): %4")
+                               .arg((delayMs + 999) / 1000)
+                               .arg(attempt)
+                               .arg(retryPolicy.maxAttempts - 1)
+                               .arg(reason);
+    setStatus(job, status);
+
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
+    if (!url.isEmpty() && !path.isEmpty())
+        db.updateStatus(url, path, status, leaseOwner(job));
+
+    Trace::asyncBegin("queue", "retry-backoff", job);
+    QTimer::singleShot(delayMs, this, [this, job]() {
+        Trace::asyncEnd("queue", "retry-backoff", job);
+        if (!jobs.contains(job) || lostLeases.contains(job)) return;
+        enqueueJob(job);
+        pumpQueue();
+    });
+}
+
+void MainWindow::skipDownload(int job, const QString& reason)
+{
+    Trace::asyncEnd("net", "transfer", job);
+    emit requestDiscardFile(job);
+    if (streamingJobs.remove(job))
+        emit requestStreamAbort(job);
+    jobAttempts.remove(job);
+    jobChunkDigests.remove(job);
+
+    const QString status = "Skipped (filter: " + reason + ")";
+    setStatus(job, status);
+
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
+    if (!url.isEmpty() && !path.isEmpty())
+        db.updateStatus(url, path, status, leaseOwner(job));
+    releaseShared(job);
+
+    scheduleHistoryRefresh();
+    pumpQueue();
+}
+
+void MainWindow::onWatchdogTick()
 {
-    const QString urlStr = ui->tableWidget->item(row, COL_URL)->text().trimmed();
-    QUrl url(urlStr);
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
 
-    if (!url.isValid() || url.scheme().isEmpty()) {
-        setStatus(row, "Error: invalid URL");
+    // A transfer is stalled when it moved fewer than stallMinBytes during a whole window.
+    const auto replies = replyWatch.keys();
+    for (QNetworkReply* reply : replies) {
+        auto it = replyWatch.find(reply);
+        if (it == replyWatch.end())
+            continue;
+
+        TransferWatch& w = it.value();
+        if (now - w.windowStartMs < stallWindowMs)
+            continue;
+
+        if (w.bytes - w.windowBytes < stallMinBytes) {
+            stalledReplies.insert(reply);
+            reply->abort();
+            continue;
+        }
+
+        w.windowBytes = w.bytes;
+        w.windowStartMs = now;
+    }
+
+    // hosts come out of Retry-After hold-off without any other event to wake the queue
+    if (!repairQueue.isEmpty())
+        pumpRepairs();
+    if (!pendingJobs.isEmpty())
+        pumpQueue();
+}
+
+void MainWindow::onSharedTick()
+{
+    if (!sharedAction->isChecked())
         return;
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (!claimedPath.isEmpty() && now - lastLeaseRenewMs >= sharedLeaseSecs * 1000 / 3) {
+        QSet<QString> owned;
+        if (db.renewLeases(workerId, sharedLeaseSecs, &owned)) {
+            // a lease that ran out (suspended machine, stalled DB) may already belong to someone else
+            const auto held = claimedPath.keys();
+            for (int job : held)
+                if (!owned.contains(jobs.url(job) + '\n' + claimedPath.value(job)))
+                    abandonJob(job);
+            if (claimedPath.size() != held.size())
+                pumpQueue();
+        }
+        lastLeaseRenewMs = now;
+    }
+
+    // claim only what can start right away; the rest stays available to the other workers
+    const int free = hostLimiter.maxTotal - hostLimiter.totalActive() - pendingJobs.size();
+    if (free > 0 && !downloadDir.isEmpty()) {
+        const QVector<ClaimedJob> claimed = db.claimJobs(workerId, free, sharedLeaseSecs);
+        for (const ClaimedJob& j : claimed) {
+            const QString key = j.url + '\n' + j.filePath;
+            int job = sharedJobs.value(key, -1);
+            if (job < 0) {
+                job = jobs.find(j.url);
+                if (job < 0) job = addUrlToTable(j.url);
+                if (job < 0) continue;
+                sharedJobs.insert(key, job);
+            }
+
+            claimedPath.insert(job, j.filePath);
+            jobAttempts.remove(job);
+            enqueueJob(job);
+        }
+
+        if (!claimed.isEmpty()) {
+            lastLeaseRenewMs = now;
+            ui->startButton->setEnabled(true);
+            pumpQueue();
+        }
     }
 
-    const QString fileName = fileNameFromUrl(urlStr);
-    const QString fullPath = QDir(downloadDir).filePath(fileName);
+    // progress and status the other workers wrote for jobs published from this table
+    if (sharedStamp.isEmpty() || sharedJobs.isEmpty())
+        return;
 
-    // stable mapping for DB updates after reply is gone
-    rowToUrl[row]  = urlStr;
-    rowToPath[row] = fullPath;
+    const auto recs = db.fetchUpdatedSince(sharedStamp, 500);
+    for (const auto& r : recs) {
+        if (r.updatedAt > sharedStamp)
+            sharedStamp = r.updatedAt;
+
+        const int job = sharedJobs.value(r.url + '\n' + r.filePath, -1);
+        if (job < 0 || claimedPath.contains(job))
+            continue;
+        setProgress(job, r.progress);
+        setStatus(job, r.status);
+    }
+}
+
+void MainWindow::releaseShared(int job)
+{
+    const QString path = claimedPath.take(job);
+    if (!path.isEmpty())
+        db.releaseLease(jobs.url(job), path, workerId);
+}
+
+QString MainWindow::leaseOwner(int job) const
+{
+    return claimedPath.contains(job) || lostLeases.contains(job) ? workerId : QString();
+}
+
+void MainWindow::abandonJob(int job)
+{
+    // the other worker's copy is the one on record now: stop every transfer and write of ours
+    claimedPath.remove(job);
+    lostLeases.insert(job);
+    const QString host = jobs.host(job);
+
+    QList<QNetworkReply*> replies;
+    for (auto it = replyToJob.cbegin(); it != replyToJob.cend(); ++it)
+        if (it.value() == job)
+            replies.append(it.key());
+    bool transferring = !replies.isEmpty();
+    for (auto it = repairReplies.cbegin(); it != repairReplies.cend(); ++it)
+        if (it.value().job == job)
+            replies.append(it.key());
+    for (QNetworkReply* reply : std::as_const(replies)) {
+        // finished handlers find no job left and only clean up
+        replyToJob.remove(reply);
+        repairReplies.remove(reply);
+        hostLimiter.release(host);
+        reply->abort();
+    }
+
+    if (MirrorDownloader* mirror = jobToMirror.take(job)) {
+        mirror->abort();
+        mirror->deleteLater();
+        hostLimiter.release(host);
+        transferring = true;
+    }
+    if (transferring)
+        Trace::asyncEnd("net", "transfer", job);
+
+    pendingJobs.removeAll(job);
+    repairQueue.remove(job);
+    repairPending.remove(job);
+    repairAttempts.remove(job);
+    repairErrors.remove(job);
+    awaitingHash.remove(job);
+    jobAttempts.remove(job);
+    jobChunkDigests.remove(job);
+    restartJobs.remove(job);
+
+    emit requestAbortFile(job);
+    if (streamingJobs.remove(job))
+        emit requestStreamAbort(job);
+
+    setStatus(job, "Lost lease (taken over by another worker)");
+}
+
+void MainWindow::startDownload(int job)
+{
+    Trace::asyncEnd("queue", "queued", job);
+    Trace::asyncBegin("net", "transfer", job);
+
+    const QString urlStr = jobs.url(job);
+    const QString fileName = UrlHelpers::fileNameFromUrl(urlStr);
+    const QString fullPath = claimedPath.value(job, QDir(downloadDir).filePath(fileName));
+    jobs.setPath(job, fullPath);
 
     db.addOrIgnoreQueued(urlStr, fullPath, fileName);
-    db.updateStatus(urlStr, fullPath, "Downloading");
-    db.updateProgress(urlStr, fullPath, 0);
+    if (!db.updateStatus(urlStr, fullPath, "Downloading", leaseOwner(job)) && claimedPath.contains(job)) {
+        hostLimiter.release(jobs.host(job));
+        abandonJob(job);
+        return;
+    }
+    queueDbProgress(job);
+
+    setStatus(job, "Downloading");
+    setProgress(job, 0);
+
+    if (jobMirrors.value(job).size() > 1) {
+        emit requestOpenFile(job, fullPath);
+        startMirrorDownload(job);
+        return;
+    }
 
-    emit requestOpenFile(row, fullPath);
+    // tree mode: bytes left by an earlier attempt are checked chunk by chunk before resuming
+    const qint64 chunkSize = treeChunkSize();
+    if (chunkSize > 0 && !restartJobs.remove(job) && QFileInfo(fullPath).size() >= chunkSize) {
+        flushChunkDigests();
+
+        qint64 recordedSize = 0;
+        QVector<QByteArray> digests;
+        if (db.chunkDigests(urlStr, fullPath, &recordedSize, &digests) && recordedSize == chunkSize) {
+            setStatus(job, "Verifying existing data");
+            emit requestVerifyChunks(job, fullPath, chunkSize, digests);
+            jobChunkDigests[job] = digests;
+            return;
+        }
+    }
+
+    beginTransfer(job, 0);
+}
+
+void MainWindow::onChunksVerified(int job, int goodChunks)
+{
+    if (!jobs.contains(job)) return;
+
+    jobChunkDigests[job].resize(goodChunks);
+    beginTransfer(job, goodChunks * treeChunkSize());
+}
+
+void MainWindow::beginTransfer(int job, qint64 offset)
+{
+    const QString fullPath = jobs.path(job);
+
+    // without a validator nothing proves the remote file is still the one on disk
+    const QString validator = offset > 0 ? db.validator(jobs.url(job), fullPath) : QString();
+    if (validator.isEmpty())
+        offset = 0;
+
+    if (offset > 0) {
+        emit requestOpenFileAt(job, fullPath, offset);
+        setStatus(job, QString("Downloading (resumed at %1 MiB)").arg(offset >> 20));
+    } else {
+        jobChunkDigests.remove(job);
+        emit requestOpenFile(job, fullPath);
+
+        // in network order from byte 0: the .gz can be inflated while it arrives
+        streamed.remove(job);
+        dropStreams.remove(job);
+        if (extractAction->isChecked() && GunzipStage().accepts(fullPath) && packThreshold() == 0) {
+            streamingJobs.insert(job);
+            emit requestStreamBegin(job, fullPath);
+        }
+    }
+
+    QNetworkRequest req(QUrl(jobs.url(job)));
+    warmer->prepare(req);
+    if (offset > 0) {
+        req.setRawHeader("Range", "bytes=" + QByteArray::number(offset) + "-");
+        req.setRawHeader("If-Range", validator.toUtf8());   // changed remotely: 200 with the whole file
+        req.setRawHeader("Accept-Encoding", "identity");   // offsets refer to the bytes on disk
+    }
 
-    QNetworkReply *reply = net.get(QNetworkRequest(url));
-    replyToRow.insert(reply, row);
-    replyToPath.insert(reply, fullPath);
+    QNetworkReply *reply = net.get(req);
+    warmer->track(reply);
+    replyToJob.insert(reply, job);
 
-    setStatus(row, "Downloading");
-    setProgress(row, 0);
+    TransferWatch watch;
+    watch.windowStartMs = QDateTime::currentMSecsSinceEpoch();
+    replyWatch.insert(reply, watch);
+
+    if (offset > 0) {
+        replyOffset.insert(reply, offset);
+
+        connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+            const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (status == 206 || status == 416 || (status >= 300 && status < 400))
+                return;
+
+            // range ignored or the file changed (If-Range): the whole body follows, start over
+            const int job = replyToJob.value(reply, -1);
+            if (job < 0 || !replyOffset.remove(reply)) return;
+            jobChunkDigests.remove(job);
+            emit requestOpenFile(job, jobs.path(job));
+        });
+    }
+
+    // pack mode keeps small files out of the download dir, extracted output included:
+    // only stream a .gz once its announced size rules packing out
+    if (offset == 0 && extractAction->isChecked() && packThreshold() > 0
+        && GunzipStage().accepts(fullPath)) {
+        connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+            const int job = replyToJob.value(reply, -1);
+            if (job < 0 || streamingJobs.contains(job)) return;
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) return;
+
+            const QVariant length = reply->header(QNetworkRequest::ContentLengthHeader);
+            if (!length.isValid() || length.toLongLong() <= packThreshold()) return;
+            streamingJobs.insert(job);
+            emit requestStreamBegin(job, jobs.path(job));
+        });
+    }
+
+    // remember what the full body came from, so a later resume can be made conditional
+    if (treeChunkSize() > 0) {
+        connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+            if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 200) return;
+            const int job = replyToJob.value(reply, -1);
+            if (job < 0) return;
+
+            // If-Range only accepts strong ETags
+            QByteArray v = reply->rawHeader("ETag").trimmed();
+            if (v.isEmpty() || v.startsWith("W/"))
+                v = reply->rawHeader("Last-Modified").trimmed();
+            db.setValidator(jobs.url(job), jobs.path(job), QString::fromLatin1(v));
+        });
+    }
+
+    // size / MIME rules can only be checked once the headers are in
+    if (linkFilter.hasResponseRules()) {
+        connect(reply, &QNetworkReply::metaDataChanged, this, [this, reply]() {
+            const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            if (status < 200 || status >= 300 || filteredReplies.contains(reply)) return;
+
+            const QVariant length = reply->header(QNetworkRequest::ContentLengthHeader);
+            const qint64 size = length.isValid() ? replyOffset.value(reply) + length.toLongLong() : -1;
+            QString reason;
+            if (linkFilter.acceptsResponse(size, reply->header(QNetworkRequest::ContentTypeHeader).toString(), &reason))
+                return;
+
+            filteredReplies.insert(reply, reason);
+            reply->abort();
+        });
+    }
 
     connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
-        const int row = replyToRow.value(reply, -1);
-        if (row < 0) return;
+        const int job = replyToJob.value(reply, -1);
+        if (job < 0 || filteredReplies.contains(reply)) return;
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 416) return;
 
         const QByteArray chunk = reply->readAll();
-        if (!chunk.isEmpty())
-            emit requestAppendChunk(row, chunk);
+        if (chunk.isEmpty()) return;
+        emit requestAppendChunk(job, chunk);
+        if (streamingJobs.contains(job))
+            emit requestStreamFeed(job, chunk);
     });
 
     connect(reply, &QNetworkReply::downloadProgress, this,
@@ -408,103 +1246,713 @@ void MainWindow::startDownloadForRow(int row)
             [this, reply]() { handleFinished(reply); });
 }
 
+void MainWindow::startMirrorDownload(int job)
+{
+    auto *mirror = new MirrorDownloader(&net, job, jobMirrors.value(job), this);
+    mirror->warmer = warmer;
+    if (linkFilter.hasResponseRules())
+        mirror->filter = &linkFilter;
+    jobToMirror.insert(job, mirror);
+
+    connect(mirror, &MirrorDownloader::chunkReady, this, &MainWindow::requestWriteAt);
+    connect(mirror, &MirrorDownloader::progress,   this, &MainWindow::onMirrorProgress);
+    connect(mirror, &MirrorDownloader::finished,   this, &MainWindow::onMirrorFinished);
+    connect(mirror, &MirrorDownloader::failed,     this, &MainWindow::onMirrorFailed);
+    connect(mirror, &MirrorDownloader::filtered,   this, &MainWindow::onMirrorFiltered);
+
+    mirror->start();
+}
+
 void MainWindow::handleProgress(QNetworkReply* reply, qint64 received, qint64 total)
 {
-    const int row = replyToRow.value(reply, -1);
-    if (row < 0) return;
+    const int job = replyToJob.value(reply, -1);
+    if (job < 0) return;
 
-    int percent = (total > 0) ? int((received * 100) / total) : 0;
-    setProgress(row, percent);
+    auto watch = replyWatch.find(reply);
+    if (watch != replyWatch.end())
+        watch->bytes = received;
+
+    const qint64 resumedAt = replyOffset.value(reply);
+    received += resumedAt;
+    if (total > 0) total += resumedAt;
+    jobs.setBytes(job, received, total);
 
-    const QString urlStr = rowToUrl.value(row);
-    const QString path   = replyToPath.value(reply);
-    if (!urlStr.isEmpty() && !path.isEmpty())
-        db.updateProgress(urlStr, path, percent);
+    int percent = (total > 0) ? int((received * 100) / total) : 0;
+    setProgress(job, percent);
+    queueDbProgress(job);
 }
 
 void MainWindow::handleFinished(QNetworkReply* reply)
 {
-    const int row = replyToRow.value(reply, -1);
-    const QString path = replyToPath.value(reply);
+    const int job = replyToJob.value(reply, -1);
+    const QString host = job >= 0 ? jobs.host(job) : QString();
+    const bool stalled = stalledReplies.remove(reply);
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const qint64 resumedAt = replyOffset.take(reply);
+    const QString filtered = filteredReplies.take(reply);
 
-    replyToRow.remove(reply);
-    replyToPath.remove(reply);
+    replyToJob.remove(reply);
+    replyWatch.remove(reply);
 
-    if (row < 0) {
+    if (job < 0) {
         reply->deleteLater();
         return;
     }
 
-    // flush remaining bytes
-    const QByteArray lastChunk = reply->readAll();
-    if (!lastChunk.isEmpty())
-        emit requestAppendChunk(row, lastChunk);
+    hostLimiter.release(host);
 
-    const QString urlStr = rowToUrl.value(row);
+    if (!filtered.isEmpty()) {
+        skipDownload(job, filtered);
+        reply->deleteLater();
+        return;
+    }
 
-    if (reply->error() != QNetworkReply::NoError) {
-        const QString err = "Error: " + reply->errorString();
-        setStatus(row, err);
-        emit requestCloseFile(row);
+    // 416 on a resume: complete only if the server's size is exactly what is on disk
+    if (resumedAt > 0 && httpStatus == 416) {
+        static const QRegularExpression re(R"(bytes\s+\*/(\d+))");
+        const auto match = re.match(QString::fromLatin1(reply->rawHeader("Content-Range")));
+        if (match.hasMatch() && match.captured(1).toLongLong() == resumedAt) {
+            completeDownload(job, host);
+        } else {
+            // shrank or unknown: the kept bytes cannot be trusted, fetch from byte 0
+            Trace::asyncEnd("net", "transfer", job);
+            jobChunkDigests.remove(job);
+            restartJobs.insert(job);
+            enqueueJob(job);
+            pumpQueue();
+        }
+        reply->deleteLater();
+        return;
+    }
 
-        if (!urlStr.isEmpty() && !path.isEmpty())
-            db.updateStatus(urlStr, path, err);
+    // flush remaining bytes
+    const QByteArray lastChunk = reply->readAll();
+    if (!lastChunk.isEmpty()) {
+        emit requestAppendChunk(job, lastChunk);
+        if (streamingJobs.contains(job))
+            emit requestStreamFeed(job, lastChunk);
+    }
+
+    if (stalled || reply->error() != QNetworkReply::NoError) {
+        const QNetworkReply::NetworkError error =
+            stalled ? QNetworkReply::TimeoutError : reply->error();
+        const QString reason = stalled ? QString("stalled") : reply->errorString();
 
+        failDownload(job, host, error, httpStatus, reason, retryPolicy.retryAfterMs(reply));
         reply->deleteLater();
         return;
     }
 
-    emit requestCloseFile(row);
+    completeDownload(job, host);
+    reply->deleteLater();
+}
+
+void MainWindow::onMirrorProgress(int job, qint64 received, qint64 total)
+{
+    jobs.setBytes(job, received, total);
+    int percent = (total > 0) ? int((received * 100) / total) : 0;
+    setProgress(job, percent);
+    queueDbProgress(job);
+}
+
+void MainWindow::onMirrorFinished(int job)
+{
+    MirrorDownloader* mirror = jobToMirror.take(job);
+    if (!mirror) return;
+
+    ui->statusbar->showMessage("Mirrors: " + mirror->summary(), 4000);
+    mirror->deleteLater();
+
+    const QString host = jobs.host(job);
+    hostLimiter.release(host);
+    completeDownload(job, host);
+}
+
+void MainWindow::onMirrorFailed(int job, const QString& reason)
+{
+    MirrorDownloader* mirror = jobToMirror.take(job);
+    if (!mirror) return;
+    mirror->deleteLater();
+
+    const QString host = jobs.host(job);
+    hostLimiter.release(host);
+    failDownload(job, host, QNetworkReply::TemporaryNetworkFailureError, 0,
+                 "all mirrors failed: " + reason, -1);
+}
+
+void MainWindow::onMirrorFiltered(int job, const QString& reason)
+{
+    MirrorDownloader* mirror = jobToMirror.take(job);
+    if (!mirror) return;
+    mirror->deleteLater();
+
+    hostLimiter.release(jobs.host(job));
+    skipDownload(job, reason);
+}
+
+void MainWindow::completeDownload(int job, const QString& host)
+{
+    // the writer already failed this job; the transfer succeeding does not undo that
+    const bool writeFailed = jobs.phase(job) == JobStore::Phase::Error;
+
+    // multiplexed hosts can take many more parallel streams than HTTP/1 connections
+    if (warmer->usesHttp2(host))
+        hostLimiter.setCeiling(host, http2HostCeiling);
+    hostLimiter.onSuccess(host);
+    jobAttempts.remove(job);
+
+    Trace::asyncEnd("net", "transfer", job);
+    Trace::asyncBegin("writer", "close-queue", job);
+    emit requestCloseFile(job);
+    if (streamingJobs.contains(job))
+        emit requestStreamEnd(job);
+
+    if (!writeFailed) {
+        const QString urlStr = jobs.url(job);
+        const QString path   = jobs.path(job);
+        if (!urlStr.isEmpty() && !path.isEmpty()
+            && !db.updateStatus(urlStr, path, "Downloaded (hashing...)", leaseOwner(job))
+            && claimedPath.contains(job)) {
+            abandonJob(job);
+            pumpQueue();
+            return;
+        }
 
-    setProgress(row, 100);
-    setStatus(row, "Downloaded (hashing...)");
+        setProgress(job, 100);
+        setStatus(job, "Downloaded (hashing...)");
+        queueDbProgress(job);
 
-    if (!urlStr.isEmpty() && !path.isEmpty()) {
-        db.updateProgress(urlStr, path, 100);
-        db.updateStatus(urlStr, path, "Downloaded (hashing...)");
+        // hashed once the writer has actually closed (or packed) the file
+        awaitingHash.insert(job);
     }
 
-    emit requestHash(row, path);
+    pumpQueue();
 
-    reply->deleteLater();
+    if (pendingJobs.isEmpty() && replyToJob.isEmpty() && jobToMirror.isEmpty()) {
+        ui->statusbar->showMessage("Batch finished. " + warmer->report(), 8000);
+    }
+}
+
+void MainWindow::failDownload(int job, const QString& host, QNetworkReply::NetworkError error,
+                              int httpStatus, const QString& reason, int retryAfterMs)
+{
+    Trace::asyncEnd("net", "transfer", job);
+    Trace::instant("net", "transfer-failed", job);
+    emit requestAbortFile(job);
+    if (streamingJobs.remove(job))
+        emit requestStreamAbort(job);
+
+    if (RetryPolicy::isCongestionSignal(error, httpStatus))
+        hostLimiter.onCongestion(host);
+
+    const int attempt = ++jobAttempts[job];
+    const bool retry = retryPolicy.classify(error, httpStatus) == RetryPolicy::Verdict::Retry
+                       && attempt < retryPolicy.maxAttempts;
+
+    if (retry) {
+        int delay = retryAfterMs;
+        if (delay >= 0)
+            hostLimiter.holdOff(host, delay);
+        else
+            delay = retryPolicy.backoffMs(attempt);
+        scheduleRetry(job, delay, reason);
+    } else {
+        const QString err = "Error: " + reason;
+        setStatus(job, err);
+        jobAttempts.remove(job);
+
+        const QString urlStr = jobs.url(job);
+        const QString path   = jobs.path(job);
+        if (!urlStr.isEmpty() && !path.isEmpty())
+            db.updateStatus(urlStr, path, err, leaseOwner(job));
+        releaseShared(job);
+    }
+
+    pumpQueue();
 }
 
 // -------------------- Worker callbacks --------------------
-void MainWindow::onWriterError(int row, const QString& message)
+void MainWindow::onWriterError(int job, const QString& message)
 {
-    setStatus(row, "Error: " + message);
+    awaitingHash.remove(job);   // no fileClosed follows an error
+    if (lostLeases.contains(job)) return;
+    setStatus(job, "Error: " + message);
 
-    const QString url  = rowToUrl.value(row);
-    const QString path = rowToPath.value(row);
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
     if (!url.isEmpty() && !path.isEmpty())
-        db.updateStatus(url, path, "Error: " + message);
+        db.updateStatus(url, path, "Error: " + message, leaseOwner(job));
+    releaseShared(job);
 }
 
-void MainWindow::onHashReady(int row, const QString& digestHex)
+void MainWindow::onFileClosed(int job)
 {
-    setStatus(row, "Done (SHA256: " + digestHex.left(12) + "...)");
+    if (!awaitingHash.remove(job))
+        return;
+
+    Trace::asyncBegin("hash", "hash-queue", job);
+
+    // a pinned SHA-256 can only be checked against the linear digest
+    const qint64 chunkSize = treeChunkSize();
+    if (chunkSize > 0 && jobExpectedSha.value(job).isEmpty())
+        emit requestTreeHash(job, jobs.path(job), chunkSize);
+    else
+        emit requestHash(job, jobs.path(job));
+}
+
+void MainWindow::onChunkHashed(int job, int index, const QByteArray& digest)
+{
+    QVector<QByteArray>& known = jobChunkDigests[job];
+    if (known.size() <= index)
+        known.resize(index + 1);
+    known[index] = digest;
+
+    ChunkDigest d;
+    d.url = jobs.url(job);
+    d.filePath = jobs.path(job);
+    d.chunkSize = treeChunkSize();
+    d.index = index;
+    d.digest = digest;
+    if (d.url.isEmpty() || d.filePath.isEmpty() || d.chunkSize <= 0)
+        return;
+
+    pendingChunkDigests.push_back(d);
+    if (!uiFrameTimer.isActive()) uiFrameTimer.start();
+}
+
+void MainWindow::onFilePacked(int job, const QString& packPath, qint64 offset, qint64 size,
+                              const QString& sha256)
+{
+    awaitingHash.remove(job);
+    discardStreamOutput(job);   // packed after all (size unknown up front): nothing loose
+    if (lostLeases.contains(job)) return;
+    if (!verifyExpected(job, sha256))
+        return;
+
+    setStatus(job, "Done (packed, SHA256: " + sha256.left(12) + "...)");
+
+    PackedEntry e;
+    e.url = jobs.url(job);
+    e.filePath = jobs.path(job);
+    e.packPath = packPath;
+    e.offset = offset;
+    e.size = size;
+    e.sha256 = sha256;
+    e.owner = leaseOwner(job);
+    if (e.url.isEmpty() || e.filePath.isEmpty())
+        return;
+    if (claimedPath.remove(job))
+        packedShared.insert(e.url + '\n' + e.filePath);
+
+    // written with the next UI frame, together with every other file packed meanwhile
+    pendingPacked.push_back(e);
+    if (!uiFrameTimer.isActive()) uiFrameTimer.start();
+}
+
+bool MainWindow::verifyExpected(int job, const QString& digestHex)
+{
+    const QString expected = jobExpectedSha.value(job);
+    if (expected.isEmpty() || expected.compare(digestHex, Qt::CaseInsensitive) == 0)
+        return true;
+
+    const QString err = "Error: SHA-256 mismatch (expected " + expected.left(12) + "...)";
+    setStatus(job, err);
+    discardStreamOutput(job);
 
-    const QString url  = rowToUrl.value(row);
-    const QString path = rowToPath.value(row);
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
     if (!url.isEmpty() && !path.isEmpty())
-        db.setHashAndDone(url, path, digestHex);
+        db.updateStatus(url, path, err, leaseOwner(job));
+    releaseShared(job);
 
-    // If user is viewing history, refresh it
-    if (ui->tabWidget->currentIndex() == 1)
-        loadHistoryTable();
+    scheduleHistoryRefresh();
+    return false;
 }
 
-void MainWindow::onHashError(int row, const QString& message)
+void MainWindow::onHashReady(int job, const QString& digestHex)
 {
-    setStatus(row, "Done (hash error: " + message + ")");
+    if (lostLeases.contains(job)) return;
 
-    const QString url  = rowToUrl.value(row);
-    const QString path = rowToPath.value(row);
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
+
+    if (!verifyExpected(job, digestHex))
+        return;
+
+    if (!url.isEmpty() && !path.isEmpty() && !db.setHashAndDone(url, path, digestHex, leaseOwner(job))
+        && claimedPath.contains(job)) {
+        abandonJob(job);
+        return;
+    }
+    setStatus(job, "Done (SHA256: " + digestHex.left(12) + "...)");
+    releaseShared(job);
+
+    scheduleHistoryRefresh();
+    startPostProcessing(job);
+}
+
+void MainWindow::onHashError(int job, const QString& message)
+{
+    if (lostLeases.contains(job)) return;
+    setStatus(job, "Done (hash error: " + message + ")");
+
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
     if (!url.isEmpty() && !path.isEmpty())
-        db.updateStatus(url, path, "Done (hash error)");
+        db.updateStatus(url, path, "Done (hash error)", leaseOwner(job));
+    releaseShared(job);
 
-    if (ui->tabWidget->currentIndex() == 1)
-        loadHistoryTable();
+    scheduleHistoryRefresh();
+}
+
+void MainWindow::onTreeHashReady(int job, const QString& rootHex, qint64 chunkSize,
+                                 const QVector<QByteArray>& digests)
+{
+    if (lostLeases.contains(job)) return;
+
+    const QString url  = jobs.url(job);
+    const QString path = jobs.path(job);
+
+    // chunks whose bytes on disk differ from what passed through the writer
+    const QVector<QByteArray> written = jobChunkDigests.value(job);
+    QVector<int> bad;
+    for (int i = 0; i < written.size(); ++i) {
+        if (written[i].isEmpty()) continue;
+        if (i >= digests.size() || written[i] != digests[i])
+            bad.append(i);
+    }
+
+    if (!bad.isEmpty()) {
+        if (repairAttempts.value(job) < 2) {
+            ++repairAttempts[job];
+            repairChunks(job, chunkSize, bad);
+            return;
+        }
+
+        const QString err = QString("Error: %1 chunk(s) still corrupted after repair").arg(bad.size());
+        setStatus(job, err);
+        repairAttempts.remove(job);
+        if (!url.isEmpty() && !path.isEmpty())
+            db.updateStatus(url, path, err, leaseOwner(job));
+        releaseShared(job);
+        scheduleHistoryRefresh();
+        return;
+    }
+
+    repairAttempts.remove(job);
+    jobChunkDigests.remove(job);
+
+    if (!url.isEmpty() && !path.isEmpty()) {
+        flushChunkDigests();
+        if (!db.setTreeHashAndDone(url, path, rootHex, chunkSize, digests, leaseOwner(job))
+            && claimedPath.contains(job)) {
+            abandonJob(job);
+            return;
+        }
+    }
+    setStatus(job, "Done (tree: " + rootHex.left(12) + "...)");
+    releaseShared(job);
+
+    scheduleHistoryRefresh();
+    startPostProcessing(job);
+}
+
+void MainWindow::repairChunks(int job, qint64 chunkSize, const QVector<int>& bad)
+{
+    setStatus(job, QString("Repairing %1 chunk(s)").arg(bad.size()));
+    emit requestOpenFileAt(job, jobs.path(job), -1);
+    repairPending[job] = bad.size();
+
+    QVector<RepairPart>& queue = repairQueue[job];
+    for (int index : bad) {
+        RepairPart part;
+        part.job = job;
+        part.pos = index * chunkSize;
+        part.end = part.pos + chunkSize - 1;
+        queue.push_back(part);
+    }
+    pumpRepairs();
+}
+
+void MainWindow::pumpRepairs()
+{
+    // repair GETs take host slots like any transfer; due parts start while slots are free
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = repairQueue.begin(); it != repairQueue.end();) {
+        const QString host = jobs.host(it.key());
+        QVector<RepairPart>& queue = it.value();
+        for (int i = 0; i < queue.size();) {
+            if (queue[i].notBeforeMs > now) {
+                ++i;
+                continue;
+            }
+            if (!hostLimiter.tryAcquire(host))
+                break;
+            startRepairPart(queue.takeAt(i));
+        }
+        if (queue.isEmpty())
+            it = repairQueue.erase(it);
+        else
+            ++it;
+    }
+}
+
+void MainWindow::startRepairPart(const RepairPart& part)
+{
+    QNetworkRequest req((QUrl(jobs.url(part.job))));
+    warmer->prepare(req);
+    req.setRawHeader("Range", "bytes=" + QByteArray::number(part.pos) + "-"
+                              + QByteArray::number(part.end));
+    req.setRawHeader("Accept-Encoding", "identity");
+    const QString validator = db.validator(jobs.url(part.job), jobs.path(part.job));
+    if (!validator.isEmpty())
+        req.setRawHeader("If-Range", validator.toUtf8());   // changed remotely: 200, not a patch
+
+    QNetworkReply* reply = net.get(req);
+    warmer->track(reply);
+    repairReplies.insert(reply, part);
+
+    TransferWatch watch;
+    watch.windowStartMs = QDateTime::currentMSecsSinceEpoch();
+    replyWatch.insert(reply, watch);
+
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        auto it = repairReplies.find(reply);
+        if (it == repairReplies.end()) return;
+        // anything but a partial response would not line up with the chunk
+        if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 206) return;
+
+        const QByteArray data = reply->readAll();
+        emit requestWriteAt(it->job, it->pos, data);
+        it->pos += data.size();
+
+        auto watch = replyWatch.find(reply);
+        if (watch != replyWatch.end())
+            watch->bytes += data.size();
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { onRepairFinished(reply); });
+}
+
+void MainWindow::onRepairFinished(QNetworkReply* reply)
+{
+    reply->deleteLater();
+
+    const bool stalled = stalledReplies.remove(reply);
+    replyWatch.remove(reply);
+
+    auto it = repairReplies.find(reply);
+    if (it == repairReplies.end()) return;
+    RepairPart part = it.value();
+    repairReplies.erase(it);
+
+    const int job = part.job;
+    const QString host = jobs.host(job);
+    hostLimiter.release(host);
+
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    const QNetworkReply::NetworkError error = stalled ? QNetworkReply::TimeoutError : reply->error();
+    if (error == QNetworkReply::NoError && httpStatus == 206) {
+        const QByteArray rest = reply->readAll();
+        if (!rest.isEmpty())
+            emit requestWriteAt(job, part.pos, rest);
+        hostLimiter.onSuccess(host);
+    } else if (error == QNetworkReply::NoError) {
+        repairErrors.insert(job, "range not honoured");
+    } else {
+        if (RetryPolicy::isCongestionSignal(error, httpStatus))
+            hostLimiter.onCongestion(host);
+
+        // the part continues where it stopped, after the same backoff as a whole transfer
+        ++part.attempts;
+        if (retryPolicy.classify(error, httpStatus) == RetryPolicy::Verdict::Retry
+            && part.attempts < retryPolicy.maxAttempts) {
+            int delay = retryPolicy.retryAfterMs(reply);
+            if (delay >= 0)
+                hostLimiter.holdOff(host, delay);
+            else
+                delay = retryPolicy.backoffMs(part.attempts);
+            part.notBeforeMs = QDateTime::currentMSecsSinceEpoch() + delay;
+            repairQueue[job].push_back(part);
+            pumpRepairs();
+            pumpQueue();
+            return;
+        }
+        repairErrors.insert(job, stalled ? QString("stalled") : reply->errorString());
+    }
+
+    pumpRepairs();
+    pumpQueue();
+
+    if (--repairPending[job] > 0) return;
+    repairPending.remove(job);
+
+    if (repairErrors.contains(job)) {
+        emit requestAbortFile(job);
+        repairAttempts.remove(job);
+
+        const QString err = "Error: chunk repair failed (" + repairErrors.take(job) + ")";
+        setStatus(job, err);
+        const QString url  = jobs.url(job);
+        const QString path = jobs.path(job);
+        if (!url.isEmpty() && !path.isEmpty())
+            db.updateStatus(url, path, err, leaseOwner(job));
+        scheduleHistoryRefresh();
+        return;
+    }
+
+    // re-hashed once closed; compared against the writer's digests again
+    setStatus(job, "Repaired (hashing...)");
+    awaitingHash.insert(job);
+    Trace::asyncBegin("writer", "close-queue", job);
+    emit requestCloseFile(job);
+}
+
+// -------------------- Post-processing --------------------
+void MainWindow::configurePostProcessing()
+{
+    std::vector<std::shared_ptr<PostStage>> stages;
+    if (extractAction->isChecked()) {
+        stages.push_back(std::make_shared<GunzipStage>());
+        stages.push_back(std::make_shared<UnzipStage>());
+        stages.push_back(std::make_shared<UntarStage>());
+    }
+
+    const QString command = appSettings().value("post/command").toString();
+    if (!command.trimmed().isEmpty())
+        stages.push_back(std::make_shared<CommandStage>(
+            command, appSettings().value("post/commandTimeoutSec", 600).toInt()));
+
+    post->setStages(std::move(stages));
+}
+
+void MainWindow::onPostCommandClicked()
+{
+    bool ok = false;
+    const QString command = QInputDialog::getText(
+        this, "Post-process command",
+        "Run after each download ({file} = downloaded path, empty = off):",
+        QLineEdit::Normal, appSettings().value("post/command").toString(), &ok);
+    if (!ok) return;
+
+    appSettings().setValue("post/command", command.trimmed());
+    configurePostProcessing();
+}
+
+void MainWindow::startPostProcessing(int job)
+{
+    if (!post->hasStages()) return;
+
+    // the stream's output is what the next stages should see
+    if (streamingJobs.contains(job)) {
+        postAfterStream.insert(job);
+        return;
+    }
+
+    QStringList skip;
+    QStringList carried;
+    auto s = streamed.find(job);
+    if (s != streamed.end()) {
+        if (s->ok && !s->skipped) {
+            skip << s->stage;
+            carried = s->outputs;
+        }
+        streamed.erase(s);
+    }
+
+    post->process(job, jobs.path(job), skip, carried);
+}
+
+void MainWindow::discardStreamOutput(int job)
+{
+    // still inflating: removed when the stream reports; already done: removed now
+    if (streamingJobs.contains(job)) {
+        dropStreams.insert(job);
+        return;
+    }
+    const StageReport report = streamed.take(job);
+    for (const QString& out : report.outputs)
+        QFile::remove(out);
+}
+
+void MainWindow::onStreamFinished(int job, const StageReport& report)
+{
+    if (!streamingJobs.remove(job)) return;
+
+    if (dropStreams.remove(job)) {
+        for (const QString& out : report.outputs)
+            QFile::remove(out);
+        postAfterStream.remove(job);
+        return;
+    }
+
+    streamed.insert(job, report);
+    onStageFinished(job, report);
+    if (postAfterStream.remove(job))
+        startPostProcessing(job);
+}
+
+void MainWindow::onStageFinished(int job, const StageReport& report)
+{
+    StageRecord rec;
+    rec.url = jobs.url(job);
+    rec.filePath = jobs.path(job);
+    rec.stage = report.stage;
+    rec.input = report.input;
+    rec.status = report.skipped ? "skipped" : report.ok ? "ok" : "failed";
+    rec.detail = report.detail;
+    rec.startedAt = QDateTime::fromMSecsSinceEpoch(report.startedMs).toUTC().toString(Qt::ISODate);
+    rec.durationMs = report.durationMs;
+    if (!rec.url.isEmpty() && !rec.filePath.isEmpty())
+        db.recordStage(rec);
+
+    if (!report.skipped)
+        ui->statusbar->showMessage(
+            QString("%1 %2 (%3 ms): %4").arg(report.stage, rec.status).arg(report.durationMs).arg(report.detail),
+            3000);
+}
+
+void MainWindow::onPostFinished(int job, bool ok)
+{
+    if (!jobs.contains(job)) return;
+    setStatus(job, jobs.statusText(job) + (ok ? " [processed]" : " [post-processing failed]"));
+}
+
+// -------------------- Retention --------------------
+
+void MainWindow::applyRetention()
+{
+    RetentionPolicy policy;
+    policy.maxAgeDays = appSettings().value("retention/maxAgeDays", 90).toInt();
+    policy.maxRows = appSettings().value("retention/maxRows", 100000).toInt();
+    policy.statuses = appSettings().value("retention/statuses", "Done,Skipped").toString()
+                          .split(',', Qt::SkipEmptyParts);
+    for (QString& st : policy.statuses)
+        st = st.trimmed();
+    policy.batchRows = qMax(1, appSettings().value("retention/batchRows", 500).toInt());
+
+    const int interval = retentionAction->isChecked()
+        ? qMax(1, appSettings().value("retention/intervalMin", 15).toInt())
+        : 0;
+    emit requestRetentionPolicy(policy, interval);
+}
+
+void MainWindow::onRetentionReport(const DbStats& stats, qint64 archived)
+{
+    auto mib = [](qint64 bytes) { return QString::number(bytes / (1024.0 * 1024.0), 'f', 1); };
+
+    QString msg = QString("db %1 MiB (wal %2 MiB, free %3 MiB), %4 rows, %5 archived in %6 batches")
+                      .arg(mib(stats.fileBytes), mib(stats.walBytes), mib(stats.freeBytes))
+                      .arg(stats.downloads).arg(stats.archivedRows).arg(stats.archiveBatches);
+    if (archived > 0)
+        msg += QString(" [+%1 just now]").arg(archived);
+    if (!stats.incrementalVacuum)
+        msg += " [compact once to enable incremental vacuum]";
+    ui->statusbar->showMessage(msg, 10000);
+
+    if (archived > 0) {
+        historyStamp.clear();   // archived rows must leave the history table: full reload
+        scheduleHistoryRefresh();
+    }
 }
 
 void MainWindow::on_actioninfo_triggered()
@@ -515,23 +1963,86 @@ void MainWindow::on_actioninfo_triggered()
 void MainWindow::onTabChanged(int index)
 {
     if (index == 1) {
+        refreshHistory();
+    }
+}
+
+void MainWindow::scheduleHistoryRefresh()
+{
+    // At most one refresh per timer period, and only while the history tab is visible.
+    if (ui->tabWidget->currentIndex() != 1) return;
+    if (!historyTimer.isActive()) historyTimer.start();
+}
+
+void MainWindow::refreshHistory()
+{
+    if (historyStamp.isEmpty()) {
+        loadHistoryTable();
+        return;
+    }
+
+    const auto recs = db.fetchUpdatedSince(historyStamp, 200);
+    if (recs.isEmpty()) return;
+
+    // more changed than the view holds: these are the oldest changes, reload the newest instead
+    if (recs.size() >= 200) {
         loadHistoryTable();
+        return;
+    }
+
+    QSet<QString> changed;
+    for (const auto& r : recs)
+        changed.insert(r.url + '\n' + r.filePath);
+
+    QTableWidget* table = ui->tableWidget_2;
+    table->setUpdatesEnabled(false);
+
+    // drop the stale copies, then put the changed rows on top (newest first)
+    for (int row = table->rowCount() - 1; row >= 0; --row) {
+        auto *it = table->item(row, COL_URL);
+        if (it && changed.contains(it->data(Qt::UserRole).toString()))
+            table->removeRow(row);
     }
+
+    for (const auto& r : recs) {
+        table->insertRow(0);
+
+        auto *urlItem = new QTableWidgetItem(r.url);
+        urlItem->setData(Qt::UserRole, r.url + '\n' + r.filePath);
+        table->setItem(0, COL_URL, urlItem);
+        table->setItem(0, COL_FILE, new QTableWidgetItem(r.fileName));
+        table->setItem(0, COL_PROGRESS, new QTableWidgetItem(QString::number(r.progress) + "%"));
+        table->setItem(0, COL_STATUS, new QTableWidgetItem(r.status));
+
+        if (r.updatedAt > historyStamp)
+            historyStamp = r.updatedAt;
+    }
+
+    while (table->rowCount() > 200)
+        table->removeRow(table->rowCount() - 1);
+
+    table->setUpdatesEnabled(true);
 }
 
 void MainWindow::loadHistoryTable()
 {
     ui->tableWidget_2->setRowCount(0);
+    historyStamp.clear();
 
     const auto recs = db.fetchRecent(200);
     for (const auto& r : recs) {
         const int row = ui->tableWidget_2->rowCount();
         ui->tableWidget_2->insertRow(row);
 
-        ui->tableWidget_2->setItem(row, COL_URL, new QTableWidgetItem(r.url));
+        auto *urlItem = new QTableWidgetItem(r.url);
+        urlItem->setData(Qt::UserRole, r.url + '\n' + r.filePath);
+        ui->tableWidget_2->setItem(row, COL_URL, urlItem);
         ui->tableWidget_2->setItem(row, COL_FILE, new QTableWidgetItem(r.fileName));
         ui->tableWidget_2->setItem(row, COL_PROGRESS, new QTableWidgetItem(QString::number(r.progress) + "%"));
         ui->tableWidget_2->setItem(row, COL_STATUS, new QTableWidgetItem(r.status));
+
+        if (r.updatedAt > historyStamp)
+            historyStamp = r.updatedAt;
     }
 
     ui->statusbar->showMessage(QString("History loaded: %1 item(s).").arg(recs.size()), 2500);
@@ -547,7 +2058,8 @@ void MainWindow::on_tableWidget_2_cellDoubleClicked(int row, int)
         return;
 
     // Add to CURRENT list (only), not history
-    addUrlToTable(urlStr);
+    const int added = addUrlToTable(urlStr);
+    applyMirrors(added, db.mirrorsFor(urlStr), QString());
 
     if (downloadDir.isEmpty()) {
         ui->statusbar->showMessage("Added to current. Choose a folder to re-download.", 3000);
@@ -555,10 +2067,19 @@ void MainWindow::on_tableWidget_2_cellDoubleClicked(int row, int)
         return;
     }
 
-    // Start it immediately: last row is the newly added one
-    const int newRow = ui->tableWidget->rowCount() - 1;
+    // Start it right away (subject to the host's slot limit)
+    const int job = added >= 0 ? added : jobs.find(urlStr);
     ui->tabWidget->setCurrentIndex(0);
-    startDownloadForRow(newRow);
+    if (job < 0) return;
+
+    // already in the list: only re-run it when nothing is in flight for it
+    const JobStore::Phase phase = jobs.phase(job);
+    if (phase != JobStore::Phase::Queued && phase != JobStore::Phase::Done
+        && phase != JobStore::Phase::Error && phase != JobStore::Phase::Skipped)
+        return;
+    jobAttempts.remove(job);
+    enqueueJob(job);
+    pumpQueue();
 }
 
 
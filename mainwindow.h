@@ -7,11 +7,25 @@
 #include <QNetworkReply>
 #include <QHash>
 #include <QThread>
+#include <QTimer>
+#include <QQueue>
+#include <QSet>
 #include <QUrl>
 
 #include "dbmanager.h"
 #include "filewriter.h"
 #include "hasher.h"
+#include "retrypolicy.h"
+#include "hostlimiter.h"
+#include "mirrordownloader.h"
+#include "connectionwarmer.h"
+#include "sitemapcrawler.h"
+#include "postprocessor.h"
+#include "linkfilter.h"
+#include "jobstore.h"
+#include "retentionworker.h"
+
+class QAction;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -26,11 +40,31 @@ public:
     ~MainWindow();
 
 signals:
-    void requestOpenFile(int row, QString path);
-    void requestAppendChunk(int row, QByteArray chunk);
-    void requestCloseFile(int row);
+    void requestOpenFile(int job, QString path);
+    void requestOpenFileAt(int job, QString path, qint64 offset);
+    void requestAppendChunk(int job, QByteArray chunk);
+    void requestWriteAt(int job, qint64 offset, QByteArray chunk);
+    void requestCloseFile(int job);
+
+    void requestAbortFile(int job);
+    void requestDiscardFile(int job);
+    void requestPackMode(bool enabled, QString packDir, qint64 threshold);
+    void requestTreeChunkSize(qint64 chunkSize);
+
+    void requestHash(int job, QString filePath);
+    void requestTreeHash(int job, QString filePath, qint64 chunkSize);
+    void requestVerifyChunks(int job, QString filePath, qint64 chunkSize, QVector<QByteArray> expected);
+
+    void requestStreamBegin(int job, QString path);
+    void requestStreamFeed(int job, QByteArray chunk);
+    void requestStreamEnd(int job);
+    void requestStreamAbort(int job);
 
-    void requestHash(int row, QString filePath);
+    void requestRetentionOpen(QString dbPath, bool rollbackJournal);
+    void requestRetentionPolicy(RetentionPolicy policy, int intervalMin);
+    void requestRetentionRun();
+    void requestCompact();
+    void requestDbStats();
 
 private slots:
     void onChooseFolderClicked();
@@ -40,16 +74,49 @@ private slots:
     void handleProgress(QNetworkReply* reply, qint64 received, qint64 total);
     void handleFinished(QNetworkReply* reply);
 
+    void onMirrorProgress(int job, qint64 received, qint64 total);
+    void onMirrorFinished(int job);
+    void onMirrorFailed(int job, const QString& reason);
+    void onMirrorFiltered(int job, const QString& reason);
+
     void onPageFetched();
 
-    void onWriterError(int row, const QString& message);
+    void onDiscoverSitemapsClicked();
+    void onSitemapUrls(const QList<SitemapEntry>& entries);
+    void onSitemapFinished(qint64 urls, int sitemapCount, const QString& error);
+
+    void pumpQueue();
+    void onWatchdogTick();
+    void onSharedTick();
+
+    void onWriterError(int job, const QString& message);
+    void onFileClosed(int job);
+    void onFilePacked(int job, const QString& packPath, qint64 offset, qint64 size, const QString& sha256);
+    void onChunkHashed(int job, int index, const QByteArray& digest);
 
-    void onHashReady(int row, const QString& digestHex);
-    void onHashError(int row, const QString& message);
+    void onPackModeToggled(bool enabled);
+    void onTreeModeToggled(bool enabled);
+    void onExportTraceClicked();
+    void onExtractPackClicked();
+
+    void onHashReady(int job, const QString& digestHex);
+    void onHashError(int job, const QString& message);
+    void onTreeHashReady(int job, const QString& rootHex, qint64 chunkSize, const QVector<QByteArray>& digests);
+    void onChunksVerified(int job, int goodChunks);
+
+    void onStageFinished(int job, const StageReport& report);
+    void onPostFinished(int job, bool ok);
+    void onStreamFinished(int job, const StageReport& report);
+    void onPostCommandClicked();
+    void onEditFilterClicked();
+    void onRetentionReport(const DbStats& stats, qint64 archived);
 
     // Tabs / history
     void onTabChanged(int index);
     void loadHistoryTable();
+    void refreshHistory();
+
+    void flushUi();
 
     void on_actioninfo_triggered();
 
@@ -58,43 +125,174 @@ private slots:
 private:
     enum Col { COL_URL=0, COL_FILE=1, COL_PROGRESS=2, COL_STATUS=3 };
 
-    QString fileNameFromUrl(const QString& urlStr) const;
     void ensureRowCells(int row);
-    void setProgress(int row, int percent);
-    void setStatus(int row, const QString& status);
+    void setProgress(int job, int percent);
+    void setStatus(int job, const QString& status);
+    void queueDbProgress(int job);   // written with the next UI frame
+    void scheduleHistoryRefresh();
+
+    bool verifyExpected(int job, const QString& digestHex);
+    void configurePostProcessing();
+    void startPostProcessing(int job);
+    void discardStreamOutput(int job);   // extracted from a download that is not kept as a file
+    qint64 packThreshold() const;   // 0 when pack mode is off
+    void applyPackMode();
+    void applyTreeMode();
+    qint64 treeChunkSize() const;   // 0 when tree hashing is off
+    void flushChunkDigests();
 
     bool urlExistsInTable(const QString& urlStr) const;
-    void addUrlToTable(const QString& urlStr);
+    int addUrlToTable(const QString& urlStr);
+    void applyMirrors(int job, const QStringList& urls, const QString& expectedSha);
 
-    void startDownloadForRow(int row);
+    void enqueueJob(int job);
+    void startDownload(int job);
+    void startMirrorDownload(int job);
+    void beginTransfer(int job, qint64 offset);
+    void repairChunks(int job, qint64 chunkSize, const QVector<int>& bad);
+    void pumpRepairs();
+    void onRepairFinished(QNetworkReply* reply);
+    void completeDownload(int job, const QString& host);
+    void failDownload(int job, const QString& host, QNetworkReply::NetworkError error,
+                      int httpStatus, const QString& reason, int retryAfterMs);
+    void scheduleRetry(int job, int delayMs, const QString& reason);
+    void skipDownload(int job, const QString& reason);
+    void releaseShared(int job);
+    void abandonJob(int job);
+    QString leaseOwner(int job) const;
 
     bool looksLikeWebPage(const QUrl& u) const;
-    static QList<QUrl> extractLinksFromHtml(const QString& html, const QUrl& baseUrl);
-    bool allowedByFilter(const QUrl& u, const QUrl& baseUrl) const;
+    static bool looksLikeSitemapSource(const QUrl& u);
+    void startSitemapDiscovery(const QUrl& u);
+    void loadLinkFilter(const QString& profile);
+    void applyRetention();
 
 private:
     Ui::MainWindow *ui;
 
     QString downloadDir;
 
-    // DB + stable mapping for DB updates
     DBManager db;
-    QHash<int, QString> rowToUrl;
-    QHash<int, QString> rowToPath;
+    bool rollbackJournal = false;   // queue/rollbackJournal: journal mode of every connection
+
+    // Every job by stable id: URL, path, host, status, progress; the table only displays it
+    JobStore jobs;
 
     QNetworkAccessManager net;
+    ConnectionWarmer* warmer = nullptr;
+    int http2HostCeiling = 64;
+
+    QHash<QNetworkReply*, int> replyToJob;
+    QHash<QNetworkReply*, qint64> replyOffset;   // resumed transfers: bytes kept on disk
+    QHash<QNetworkReply*, QString> filteredReplies;   // aborted by size/MIME rules -> reason
+
+    // Which discovered links are wanted (active profile from settings.ini)
+    LinkFilter linkFilter;
+    QString filterProfile;
 
-    QHash<QNetworkReply*, int> replyToRow;
-    QHash<QNetworkReply*, QString> replyToPath;
+    // Multi-mirror jobs: all equivalent URLs (primary first) and the digest to verify against
+    QHash<int, QStringList> jobMirrors;
+    QHash<int, QString> jobExpectedSha;
+    QHash<int, MirrorDownloader*> jobToMirror;
+
+    // Scheduling: rows waiting for a per-host slot, retry bookkeeping, stall watchdog
+    struct TransferWatch {
+        qint64 bytes = 0;
+        qint64 windowBytes = 0;
+        qint64 windowStartMs = 0;
+    };
+
+    RetryPolicy retryPolicy;
+    HostLimiter hostLimiter;
+    QQueue<int> pendingJobs;
+    QHash<int, int> jobAttempts;
+    QHash<QNetworkReply*, TransferWatch> replyWatch;
+    QSet<QNetworkReply*> stalledReplies;
+    QTimer watchdogTimer;
+
+    int stallWindowMs = 30000;
+    qint64 stallMinBytes = 1024;
 
     QThread writerThread;
     FileWriterWorker* writer = nullptr;
 
     QThread hashThread;
     HasherWorker* hasher = nullptr;
+    QSet<int> awaitingHash;   // downloaded jobs whose file the writer has yet to close
+
+    // Tree hashing: digests of the chunks as they were written, and ranged re-fetches
+    // of chunks that no longer match on disk
+    struct RepairPart {
+        int job = -1;
+        qint64 pos = 0;           // next byte to write
+        qint64 end = 0;           // inclusive
+        int attempts = 0;
+        qint64 notBeforeMs = 0;   // retry backoff
+    };
+    void startRepairPart(const RepairPart& part);
+
+    QAction* treeAction = nullptr;
+    QHash<int, QVector<QByteArray>> jobChunkDigests;
+    QVector<ChunkDigest> pendingChunkDigests;
+    QHash<QNetworkReply*, RepairPart> repairReplies;
+    QHash<int, QVector<RepairPart>> repairQueue;   // parts waiting for a host slot or their backoff
+    QHash<int, int> repairPending;
+    QHash<int, int> repairAttempts;
+    QHash<int, QString> repairErrors;
+    QSet<int> restartJobs;   // resume refused (size mismatch): next start fetches from byte 0
+
+    // Post-processing: stages run after hashing; .gz is inflated while it downloads
+    PostProcessor* post = nullptr;
+    QThread extractThread;
+    StreamExtractWorker* extractor = nullptr;
+    QAction* extractAction = nullptr;
+    QSet<int> streamingJobs;             // stream still open on the extract thread
+    QHash<int, StageReport> streamed;    // finished streams, consumed by startPostProcessing
+    QSet<int> postAfterStream;           // hashed before their stream finished
+    QSet<int> dropStreams;               // output to delete once the stream reports
+
+    // Shared queue: Start All publishes to the DB; this and other instances (GUIs or
+    // `--worker` processes) claim jobs under leases kept alive by the shared tick
+    QAction* sharedAction = nullptr;
+    QString workerId;
+    int sharedLeaseSecs = 60;
+    QTimer sharedTimer;
+    qint64 lastLeaseRenewMs = 0;
+    QString sharedStamp;                 // newest updated_at merged into the table
+    QHash<QString, int> sharedJobs;      // url '\n' file_path -> job
+    QHash<int, QString> claimedPath;     // jobs we hold a lease on -> their file_path
+    QSet<int> lostLeases;                // leases another worker took over: late results are dropped
+    QSet<QString> packedShared;          // leased jobs packed, released once recorded
+
+    // History retention: archiving, incremental vacuum and checkpoints on their own connection
+    QThread retentionThread;
+    RetentionWorker* retention = nullptr;
+    QAction* retentionAction = nullptr;
+
+    // Small-file pack mode
+    QAction* packAction = nullptr;
+    QVector<PackedEntry> pendingPacked;
+
+    // Frame-coalesced UI: cell changes and progress writes are applied once per frame
+    enum Dirty : quint8 { DIRTY_PROGRESS = 1, DIRTY_STATUS = 2 };
+
+    QHash<int, quint8> dirtyJobs;    // job -> Dirty bits
+    QSet<int> dirtyDbProgress;
+    QTimer uiFrameTimer;
+
+    QTimer historyTimer;
+    QString historyStamp;   // newest updated_at shown in the history tab
 
     QNetworkReply* pageReply = nullptr;
     QUrl pageBaseUrl;
+
+    // Sitemap discovery
+    SitemapCrawler* sitemaps = nullptr;
+    QUrl sitemapBaseUrl;
+    QHash<QString, QString> sitemapDoneTimes;
+    qint64 sitemapAdded = 0;
+    qint64 sitemapSkipped = 0;
+    QAction* skipUnchangedAction = nullptr;
 };
 
 #endif
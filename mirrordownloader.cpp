@@ -0,0 +1,446 @@
+#include "mirrordownloader.h"
+#include "connectionwarmer.h"
+#include "linkfilter.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <algorithm>
+
+static qint64 nowMs()
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+MirrorDownloader::MirrorDownloader(QNetworkAccessManager* net, int job, const QStringList& urls,
+                                   QObject* parent)
+    : QObject(parent)
+    , net(net)
+    , job(job)
+{
+    for (const QString& u : urls) {
+        Mirror m;
+        m.url = QUrl(u.trimmed());
+        if (m.url.isValid() && !m.url.scheme().isEmpty())
+            mirrors.push_back(m);
+    }
+
+    stallTimer.setInterval(1000);
+    connect(&stallTimer, &QTimer::timeout, this, &MirrorDownloader::onStallTick);
+}
+
+MirrorDownloader::~MirrorDownloader()
+{
+    abort();
+}
+
+void MirrorDownloader::start()
+{
+    if (mirrors.isEmpty()) {
+        done = true;
+        emit failed(job, "no valid mirror URL");
+        return;
+    }
+
+    // Everybody races for the whole file; the first mirror to deliver data wins.
+    racing = true;
+    const Segment whole;
+    for (int m = 0; m < mirrors.size(); ++m)
+        startStream(m, whole);
+
+    stallTimer.start();
+}
+
+void MirrorDownloader::abort()
+{
+    done = true;
+    stallTimer.stop();
+
+    const auto replies = streams.keys();
+    for (QNetworkReply* r : replies)
+        dropStream(r);
+}
+
+QString MirrorDownloader::summary() const
+{
+    QStringList parts;
+    for (const Mirror& m : mirrors) {
+        QString s = QString("%1 %2 KB/s").arg(m.url.host()).arg(qRound(m.bps / 1024.0));
+        if (m.disabled) s += " (failed)";
+        parts << s;
+    }
+    return parts.join(", ");
+}
+
+// -------------------- Streams --------------------
+QNetworkReply* MirrorDownloader::startStream(int mirror, const Segment& seg)
+{
+    QNetworkRequest req(mirrors[mirror].url);
+
+    // byte offsets must refer to the stored representation, not a compressed one
+    req.setRawHeader("Accept-Encoding", "identity");
+    if (seg.begin > 0 || seg.end >= 0) {
+        QByteArray range = "bytes=" + QByteArray::number(seg.begin) + "-";
+        if (seg.end >= 0) range += QByteArray::number(seg.end);
+        req.setRawHeader("Range", range);
+    }
+
+    if (warmer) warmer->prepare(req);
+
+    QNetworkReply* reply = net->get(req);
+    if (warmer) warmer->track(reply);
+
+    Stream s;
+    s.mirror = mirror;
+    s.seg = seg;
+    s.startedMs = s.lastDataMs = nowMs();
+    streams.insert(reply, s);
+    mirrors[mirror].active++;
+
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { onStreamData(reply); });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { onStreamFinished(reply); });
+    return reply;
+}
+
+void MirrorDownloader::dropStream(QNetworkReply* reply)
+{
+    auto it = streams.find(reply);
+    if (it == streams.end()) return;
+
+    mirrors[it->mirror].active--;
+    streams.erase(it);
+
+    reply->disconnect(this);
+    reply->abort();
+    reply->deleteLater();
+}
+
+bool MirrorDownloader::validate(QNetworkReply* reply, Stream& s)
+{
+    Mirror& m = mirrors[s.mirror];
+    const int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (status == 206) {
+        static const QRegularExpression re(R"(bytes\s+(\d+)-(\d+)/(\d+|\*))");
+        const auto match = re.match(QString::fromLatin1(reply->rawHeader("Content-Range")));
+        if (!match.hasMatch() || match.captured(1).toLongLong() != s.seg.begin)
+            return false;
+
+        m.ranges = RangesYes;
+        if (match.captured(3) != "*") {
+            const qint64 size = match.captured(3).toLongLong();
+            if (total < 0) total = size;
+            else if (size != total) return false;   // different file behind this mirror
+        }
+        return true;
+    }
+
+    if (status == 200 || status == 0) {
+        if (s.seg.begin != 0) {
+            m.ranges = RangesNo;
+            return false;
+        }
+
+        if (reply->rawHeader("Accept-Ranges").trimmed().toLower() == "bytes")
+            m.ranges = RangesYes;
+
+        const QVariant len = reply->header(QNetworkRequest::ContentLengthHeader);
+        if (len.isValid()) {
+            const qint64 size = len.toLongLong();
+            if (total < 0) total = size;
+            else if (size != total) return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void MirrorDownloader::pickRaceWinner(QNetworkReply* winner)
+{
+    racing = false;
+
+    const auto replies = streams.keys();
+    for (QNetworkReply* r : replies)
+        if (r != winner) dropStream(r);
+
+    auto it = streams.find(winner);
+    if (it != streams.end() && total >= 0)
+        it->seg.end = total - 1;
+
+    // size known now: let the other mirrors take their share right away
+    fillStreams();
+}
+
+void MirrorDownloader::onStreamData(QNetworkReply* reply)
+{
+    if (done) return;
+
+    auto it = streams.find(reply);
+    if (it == streams.end()) return;
+
+    if (!it->validated) {
+        if (!validate(reply, it.value())) {
+            const Mirror& m = mirrors[it->mirror];
+            streamFailed(reply, QString("mirror %1 sent an unusable response").arg(m.url.host()));
+            return;
+        }
+        it->validated = true;
+
+        // the same size / MIME rules as a single-source download, once per file
+        if (filter && !responseChecked) {
+            responseChecked = true;
+            QString reason;
+            const QString type = reply->header(QNetworkRequest::ContentTypeHeader).toString();
+            if (!filter->acceptsResponse(total, type, &reason)) {
+                abort();
+                emit filtered(job, reason);
+                return;
+            }
+        }
+
+        if (racing) {
+            pickRaceWinner(reply);
+            it = streams.find(reply);
+            if (it == streams.end()) return;
+        }
+    }
+
+    QByteArray data = reply->readAll();
+    Stream& s = it.value();
+
+    if (s.seg.end >= 0) {
+        const qint64 room = s.seg.end - s.seg.begin + 1;
+        if (data.size() > room) data.truncate(int(room));
+    }
+
+    if (!data.isEmpty()) {
+        emit chunkReady(job, s.seg.begin, data);
+
+        s.seg.begin += data.size();
+        s.bytes += data.size();
+        s.lastDataMs = nowMs();
+        mirrors[s.mirror].bytes += data.size();
+        received += data.size();
+
+        emit progress(job, received, total);
+    }
+
+    if (s.seg.end >= 0 && s.seg.begin > s.seg.end) {
+        noteThroughput(s);
+        dropStream(reply);
+        fillStreams();
+        checkDone();
+    }
+}
+
+void MirrorDownloader::onStreamFinished(QNetworkReply* reply)
+{
+    if (!streams.contains(reply)) {
+        reply->deleteLater();
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        streamFailed(reply, reply->errorString());
+        return;
+    }
+
+    // drain what is left; completes (and drops) the stream if its range is done
+    onStreamData(reply);
+
+    auto it = streams.find(reply);
+    if (it == streams.end()) return;
+
+    const Stream s = it.value();
+    if (s.seg.end < 0) {
+        // size was unknown: EOF is the end of the file
+        total = s.seg.begin;
+        noteThroughput(s);
+        dropStream(reply);
+        checkDone();
+        return;
+    }
+
+    streamFailed(reply, QString("mirror %1 closed the connection early")
+                            .arg(mirrors[s.mirror].url.host()));
+}
+
+void MirrorDownloader::streamFailed(QNetworkReply* reply, const QString& reason)
+{
+    auto it = streams.find(reply);
+    if (it == streams.end()) return;
+
+    const Stream s = it.value();
+    lastError = reason;
+    dropStream(reply);
+
+    // lacking range support is not a broken mirror; it just won't get partial ranges
+    Mirror& m = mirrors[s.mirror];
+    const bool rangeRefusal = s.seg.begin > 0 && m.ranges == RangesNo && !s.validated;
+    if (!rangeRefusal && ++m.failures >= maxMirrorFailures)
+        m.disabled = true;
+
+    // while racing, the remaining racers still cover the whole file
+    if (!(racing && !streams.isEmpty())) {
+        racing = false;
+
+        Segment rest = s.seg;
+        if (rest.end < 0 && total >= 0) rest.end = total - 1;
+        if (rest.end < 0 || rest.begin <= rest.end)
+            todo.prepend(rest);
+    }
+
+    fillStreams();
+    checkDone();
+}
+
+void MirrorDownloader::onStallTick()
+{
+    const qint64 now = nowMs();
+
+    const auto replies = streams.keys();
+    for (QNetworkReply* r : replies) {
+        auto it = streams.find(r);
+        if (it == streams.end()) continue;
+
+        if (now - it->lastDataMs > stallMs)
+            streamFailed(r, QString("mirror %1 stalled").arg(mirrors[it->mirror].url.host()));
+    }
+
+    // free slots (a stream finished early, a mirror came back) split the largest range left
+    fillStreams();
+}
+
+void MirrorDownloader::noteThroughput(const Stream& s)
+{
+    Mirror& m = mirrors[s.mirror];
+    const double sample = rate(s);
+    m.bps = m.bps > 0 ? 0.7 * m.bps + 0.3 * sample : sample;
+}
+
+double MirrorDownloader::rate(const Stream& s)
+{
+    const qint64 elapsed = qMax<qint64>(1, nowMs() - s.startedMs);
+    return s.bytes * 1000.0 / elapsed;
+}
+
+// -------------------- Scheduling --------------------
+bool MirrorDownloader::canServe(int mirror, const Segment& seg) const
+{
+    const Mirror& m = mirrors[mirror];
+    if (m.disabled || m.active >= streamsPerMirror) return false;
+    return seg.begin == 0 || m.ranges != RangesNo;
+}
+
+int MirrorDownloader::bestIdleMirror(const Segment& seg) const
+{
+    int best = -1;
+    for (int m = 0; m < mirrors.size(); ++m) {
+        if (!canServe(m, seg)) continue;
+        if (best < 0
+            || mirrors[m].bps > mirrors[best].bps
+            || (mirrors[m].bps == mirrors[best].bps && mirrors[m].active < mirrors[best].active))
+            best = m;
+    }
+    return best;
+}
+
+void MirrorDownloader::fillStreams()
+{
+    if (done || racing) return;
+
+    // ranges handed back by failed mirrors go first, to the fastest mirror available
+    for (int i = 0; i < todo.size();) {
+        const int m = bestIdleMirror(todo[i]);
+        if (m < 0) {
+            ++i;
+            continue;
+        }
+        startStream(m, todo.takeAt(i));
+    }
+
+    // small files (or unknown size) stay with the race winner
+    if (!todo.isEmpty() || total < raceThreshold) return;
+
+    QVector<int> order;
+    for (int m = 0; m < mirrors.size(); ++m) order.push_back(m);
+    std::sort(order.begin(), order.end(),
+              [this](int a, int b) { return mirrors[a].bps > mirrors[b].bps; });
+
+    for (int m : order) {
+        while (!mirrors[m].disabled && mirrors[m].ranges != RangesNo
+               && mirrors[m].active < streamsPerMirror) {
+            if (!stealFor(m)) break;
+        }
+    }
+}
+
+bool MirrorDownloader::stealFor(int thief)
+{
+    QNetworkReply* victim = nullptr;
+    qint64 largest = 0;
+    for (auto it = streams.cbegin(); it != streams.cend(); ++it) {
+        if (it->seg.end < 0) continue;
+        const qint64 left = it->seg.end - it->seg.begin + 1;
+        if (left > largest) {
+            largest = left;
+            victim = it.key();
+        }
+    }
+    if (!victim || largest < 2 * minSegment) return false;
+
+    Stream& v = streams[victim];
+
+    // the thief takes the tail, sized by how fast it is relative to the victim
+    const double thiefRate = mirrors[thief].bps;
+    const double victimRate = qMax(rate(v), mirrors[v.mirror].bps);
+    double share = (thiefRate > 0 && victimRate > 0) ? thiefRate / (thiefRate + victimRate) : 0.5;
+    share = qBound(0.1, share, 0.9);
+
+    qint64 cut = v.seg.end + 1 - qint64(largest * share);
+    cut = qBound(v.seg.begin + minSegment, cut, v.seg.end + 1 - minSegment);
+
+    Segment stolen;
+    stolen.begin = cut;
+    stolen.end = v.seg.end;
+    v.seg.end = cut - 1;
+
+    startStream(thief, stolen);
+    return true;
+}
+
+void MirrorDownloader::checkDone()
+{
+    if (done || racing || !streams.isEmpty()) return;
+
+    if (todo.isEmpty()) {
+        done = true;
+        stallTimer.stop();
+        emit finished(job);
+        return;
+    }
+
+    // Nobody can take the remaining ranges. If a mirror without range support is
+    // still healthy, start over from byte 0 on it; otherwise give up.
+    bool usable = false;
+    for (const Mirror& m : mirrors)
+        usable = usable || !m.disabled;
+
+    if (usable) {
+        todo.clear();
+        Segment whole;
+        whole.end = total >= 0 ? total - 1 : -1;
+        todo.append(whole);
+        received = 0;
+
+        fillStreams();
+        if (!streams.isEmpty()) return;
+    }
+
+    done = true;
+    stallTimer.stop();
+    emit failed(job, lastError.isEmpty() ? QString("all mirrors failed") : lastError);
+}
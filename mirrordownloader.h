@@ -0,0 +1,112 @@
+#ifndef MIRRORDOWNLOADER_H
+#define MIRRORDOWNLOADER_H
+
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QTimer>
+#include <QUrl>
+#include <QVector>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+class ConnectionWarmer;
+class LinkFilter;
+
+// Fetches one file from several equivalent mirrors. All mirrors race for the first
+// byte; small files stay with the winner, large ones are split by work stealing so
+// idle mirrors take over part of the busiest range (sized by measured throughput).
+// A broken or stalled mirror hands its remaining range back to the others.
+class MirrorDownloader : public QObject {
+    Q_OBJECT
+public:
+    MirrorDownloader(QNetworkAccessManager* net, int job, const QStringList& urls,
+                     QObject* parent = nullptr);
+    ~MirrorDownloader() override;
+
+    void start();
+    void abort();
+
+    QString summary() const;
+
+    qint64 raceThreshold = 4 * 1024 * 1024;
+    qint64 minSegment = 1024 * 1024;
+    int streamsPerMirror = 2;
+    int maxMirrorFailures = 2;
+    int stallMs = 20000;
+
+    ConnectionWarmer* warmer = nullptr;   // optional: HTTP/2, TLS tickets, connection stats
+    const LinkFilter* filter = nullptr;   // optional: size / MIME response rules
+
+signals:
+    void chunkReady(int job, qint64 offset, QByteArray chunk);
+    void progress(int job, qint64 received, qint64 total);
+    void finished(int job);
+    void failed(int job, QString reason);
+    void filtered(int job, QString reason);   // first response broke a response rule
+
+private:
+    enum RangeSupport { RangesUnknown = -1, RangesNo = 0, RangesYes = 1 };
+
+    struct Mirror {
+        QUrl url;
+        int ranges = RangesUnknown;
+        bool disabled = false;
+        int failures = 0;
+        int active = 0;
+        qint64 bytes = 0;
+        double bps = 0;     // smoothed throughput of finished streams
+    };
+
+    struct Segment {
+        qint64 begin = 0;   // next byte to write
+        qint64 end = -1;    // inclusive; -1 = until EOF
+    };
+
+    struct Stream {
+        int mirror = -1;
+        Segment seg;
+        bool validated = false;
+        qint64 startedMs = 0;
+        qint64 lastDataMs = 0;
+        qint64 bytes = 0;
+    };
+
+    QNetworkReply* startStream(int mirror, const Segment& seg);
+    void dropStream(QNetworkReply* reply);
+
+    void onStreamData(QNetworkReply* reply);
+    void onStreamFinished(QNetworkReply* reply);
+    void onStallTick();
+
+    bool validate(QNetworkReply* reply, Stream& s);
+    void pickRaceWinner(QNetworkReply* winner);
+    void streamFailed(QNetworkReply* reply, const QString& reason);
+    void noteThroughput(const Stream& s);
+
+    void fillStreams();
+    bool stealFor(int mirror);
+    bool canServe(int mirror, const Segment& seg) const;
+    int bestIdleMirror(const Segment& seg) const;
+    void checkDone();
+
+    static double rate(const Stream& s);
+
+    QNetworkAccessManager* net;
+    int job;
+    QVector<Mirror> mirrors;
+    QHash<QNetworkReply*, Stream> streams;
+    QList<Segment> todo;
+
+    qint64 total = -1;
+    qint64 received = 0;
+    bool racing = false;
+    bool responseChecked = false;
+    bool done = false;
+    QString lastError;
+    QTimer stallTimer;
+};
+
+#endif
@@ -9,21 +9,65 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    blockreader.cpp \
+    connectionwarmer.cpp \
     dbmanager.cpp \
     filewriter.cpp \
+    gzipstream.cpp \
     hasher.cpp \
+    hostlimiter.cpp \
+    jobstore.cpp \
+    linkfilter.cpp \
+    linkfilterdialog.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    mirrordownloader.cpp \
+    packfile.cpp \
+    postprocessor.cpp \
+    poststage.cpp \
+    queueworker.cpp \
+    retentionworker.cpp \
+    retrypolicy.cpp \
+    sitemapcrawler.cpp \
+    tracer.cpp \
+    urlhelpers.cpp
 
 HEADERS += \
+    blockreader.h \
+    connectionwarmer.h \
     dbmanager.h \
     filewriter.h \
+    gzipstream.h \
     hasher.h \
-    mainwindow.h
+    hostlimiter.h \
+    jobstore.h \
+    linkfilter.h \
+    linkfilterdialog.h \
+    mainwindow.h \
+    mirrordownloader.h \
+    packfile.h \
+    postprocessor.h \
+    poststage.h \
+    queueworker.h \
+    retentionworker.h \
+    retrypolicy.h \
+    sitemapcrawler.h \
+    tracer.h \
+    urlhelpers.h
+
+# streaming inflate for .gz sitemaps and downloads, zip members
+LIBS += -lz
 
 FORMS += \
     mainwindow.ui
 
+# `make bench`: build bench/ next to this build and write bench-results.json
+bench.commands = $(MKDIR) $$shell_path($$OUT_PWD/bench) && \
+                 cd $$shell_path($$OUT_PWD/bench) && \
+                 $$QMAKE_QMAKE $$shell_path($$PWD/bench/bench.pro) && $(MAKE) && \
+                 ./bench --out $$shell_path($$OUT_PWD/bench-results.json)
+QMAKE_EXTRA_TARGETS += bench
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
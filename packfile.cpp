@@ -0,0 +1,233 @@
+#include "packfile.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <cstring>
+
+static const int BLOCK = 512;
+
+static qint64 padded(qint64 n)
+{
+    return (n + BLOCK - 1) / BLOCK * BLOCK;
+}
+
+static void putOctal(char* field, int width, qint64 value)
+{
+    // width-1 zero-padded octal digits followed by NUL
+    const QByteArray digits = QByteArray::number(value, 8).rightJustified(width - 1, '0');
+    memcpy(field, digits.constData(), size_t(width - 1));
+    field[width - 1] = '\0';
+}
+
+static qint64 parseOctal(const char* field, int width)
+{
+    qint64 value = 0;
+    for (int i = 0; i < width; ++i) {
+        const char c = field[i];
+        if (c == ' ' && value == 0) continue;
+        if (c < '0' || c > '7') break;
+        value = value * 8 + (c - '0');
+    }
+    return value;
+}
+
+static QByteArray ustarHeader(char type, const QByteArray& name, qint64 size)
+{
+    QByteArray h(BLOCK, '\0');
+    char* p = h.data();
+
+    memcpy(p, name.constData(), size_t(qMin(name.size(), 100)));
+    putOctal(p + 100, 8, 0644);
+    putOctal(p + 108, 8, 0);
+    putOctal(p + 116, 8, 0);
+    putOctal(p + 124, 12, size);
+    putOctal(p + 136, 12, QDateTime::currentSecsSinceEpoch());
+    memset(p + 148, ' ', 8);
+    p[156] = type;
+    memcpy(p + 257, "ustar", 6);
+    memcpy(p + 263, "00", 2);
+
+    unsigned sum = 0;
+    for (int i = 0; i < BLOCK; ++i)
+        sum += static_cast<unsigned char>(p[i]);
+    putOctal(p + 148, 7, sum);
+    p[155] = ' ';
+
+    return h;
+}
+
+// Drops leading bytes until n are left, without starting inside a UTF-8 sequence.
+static QByteArray utf8Tail(const QByteArray& s, int n)
+{
+    int from = qMax(0, s.size() - n);
+    while (from < s.size() && (static_cast<unsigned char>(s[from]) & 0xC0) == 0x80)
+        ++from;
+    return s.mid(from);
+}
+
+static QByteArray paxPathRecord(const QByteArray& path)
+{
+    // "<len> path=<value>\n", where <len> counts the whole record including itself
+    const QByteArray body = " path=" + path + "\n";
+    int len = body.size() + 1;
+    while (QByteArray::number(len).size() + body.size() != len)
+        len = QByteArray::number(len).size() + body.size();
+    return QByteArray::number(len) + body;
+}
+
+PackWriter::PackWriter(const QString& dir, qint64 maxPackSize)
+    : dir(dir)
+    , maxPackSize(maxPackSize)
+{
+}
+
+PackWriter::~PackWriter()
+{
+    close();
+}
+
+void PackWriter::close()
+{
+    if (file.isOpen()) {
+        file.flush();
+        file.close();
+    }
+}
+
+bool PackWriter::openNext()
+{
+    close();
+    QDir().mkpath(dir);
+
+    QString path;
+    do {
+        path = QDir(dir).filePath(QString("pack-%1.tar").arg(++seq, 4, 10, QChar('0')));
+    } while (QFileInfo::exists(path));
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite))
+        return false;
+
+    endPos = 0;
+    return file.write(QByteArray(2 * BLOCK, '\0')) == 2 * BLOCK;
+}
+
+bool PackWriter::writeMember(char type, const QByteArray& name, const QByteArray& data)
+{
+    QByteArray block = ustarHeader(type, name, data.size());
+    block += data;
+    block += QByteArray(int(padded(data.size()) - data.size()), '\0');
+
+    if (!file.seek(endPos) || file.write(block) != block.size())
+        return false;
+    endPos += block.size();
+    return true;
+}
+
+QString PackWriter::uniqueName(const QString& name)
+{
+    // same file name from different URLs: "a.bin", "a-2.bin", "a-3.bin", ...
+    QString candidate = name;
+    const QFileInfo fi(name);
+    const QString base = fi.completeBaseName();
+    const QString suffix = fi.suffix().isEmpty() ? QString() : "." + fi.suffix();
+    for (int n = 2; names.contains(candidate); ++n)
+        candidate = base + "-" + QString::number(n) + suffix;
+
+    names.insert(candidate);
+    return candidate;
+}
+
+qint64 PackWriter::append(const QString& name, const QByteArray& data, QString* packPath)
+{
+    const qint64 needed = 3 * BLOCK + padded(data.size());
+    if (!file.isOpen() || (endPos > 0 && endPos + needed + 2 * BLOCK > maxPackSize)) {
+        if (!openNext())
+            return -1;
+    }
+
+    QByteArray utf8 = uniqueName(name).toUtf8();
+    if (utf8.size() > 100) {
+        // long names travel in a PAX extended header; the ustar field keeps a truncated copy
+        if (!writeMember('x', "PaxHeader", paxPathRecord(utf8)))
+            return -1;
+        utf8 = utf8Tail(utf8, 100);
+    }
+
+    const qint64 dataOffset = endPos + BLOCK;
+    if (!writeMember('0', utf8, data))
+        return -1;
+
+    // keep the archive terminated so it is readable between appends
+    if (file.write(QByteArray(2 * BLOCK, '\0')) != 2 * BLOCK)
+        return -1;
+
+    if (packPath) *packPath = file.fileName();
+    return dataOffset;
+}
+
+int PackWriter::extract(const QString& packPath, const QString& destDir, QString* error)
+{
+    QFile in(packPath);
+    if (!in.open(QIODevice::ReadOnly)) {
+        if (error) *error = "Cannot open pack";
+        return -1;
+    }
+
+    const QDir dest(destDir);
+    int extracted = 0;
+    QByteArray longName;
+
+    while (true) {
+        const QByteArray h = in.read(BLOCK);
+        if (h.size() < BLOCK || h.count('\0') == BLOCK)
+            break;
+
+        const qint64 size = parseOctal(h.constData() + 124, 12);
+        const char type = h.at(156);
+        const qint64 next = in.pos() + padded(size);
+
+        QByteArray name = longName;
+        longName.clear();
+        if (name.isEmpty()) {
+            name = QByteArray(h.constData(), 100);
+            name.truncate(name.indexOf('\0') < 0 ? 100 : name.indexOf('\0'));
+            QByteArray prefix(h.constData() + 345, 155);
+            prefix.truncate(prefix.indexOf('\0') < 0 ? 155 : prefix.indexOf('\0'));
+            if (!prefix.isEmpty()) name = prefix + "/" + name;
+        }
+
+        if (type == 'x') {
+            const QByteArray records = in.read(size);
+            const int at = records.indexOf(" path=");
+            if (at >= 0) {
+                const int end = records.indexOf('\n', at);
+                longName = records.mid(at + 6, end - at - 6);
+            }
+        } else if (type == '0' || type == '\0') {
+            const QString rel = QDir::cleanPath(QString::fromUtf8(name));
+            if (rel.isEmpty() || rel == ".." || rel.startsWith("../") || QDir::isAbsolutePath(rel)) {
+                if (error) *error = "Unsafe member path: " + rel;
+                return -1;
+            }
+
+            const QString outPath = dest.filePath(rel);
+            QDir().mkpath(QFileInfo(outPath).absolutePath());
+
+            QFile out(outPath);
+            if (!out.open(QIODevice::WriteOnly)) {
+                if (error) *error = "Cannot write " + outPath;
+                return -1;
+            }
+            out.write(in.read(size));
+            out.close();
+            extracted++;
+        }
+
+        if (!in.seek(next))
+            break;
+    }
+
+    return extracted;
+}
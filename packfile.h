@@ -0,0 +1,41 @@
+#ifndef PACKFILE_H
+#define PACKFILE_H
+
+
+#include <QByteArray>
+#include <QFile>
+#include <QSet>
+#include <QString>
+
+// Appends small files as members of rolling ustar archives (pack-0001.tar, ...).
+// The archive is kept valid after every append, so plain `tar xf` works on it at
+// any time; the returned data offsets let a member be read back with one seek.
+class PackWriter {
+public:
+    explicit PackWriter(const QString& dir, qint64 maxPackSize = 512LL * 1024 * 1024);
+    ~PackWriter();
+
+    // Returns the offset of the member's data inside *packPath, or -1 on error. A name
+    // already used by this writer gets a numbered variant so extraction keeps both.
+    qint64 append(const QString& name, const QByteArray& data, QString* packPath);
+    void close();
+
+    QString directory() const { return dir; }
+
+    // Extracts every regular member of a pack into destDir; returns the number of files.
+    static int extract(const QString& packPath, const QString& destDir, QString* error = nullptr);
+
+private:
+    bool openNext();
+    bool writeMember(char type, const QByteArray& name, const QByteArray& data);
+    QString uniqueName(const QString& name);
+
+    QString dir;
+    qint64 maxPackSize;
+    QFile file;
+    qint64 endPos = 0;   // where the next member goes (start of the end-of-archive marker)
+    int seq = 0;
+    QSet<QString> names;   // member names written so far, across all packs
+};
+
+#endif
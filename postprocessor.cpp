@@ -0,0 +1,185 @@
+#include "postprocessor.h"
+#include "gzipstream.h"
+#include "tracer.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMetaObject>
+#include <QPointer>
+#include <QThread>
+#include <utility>
+
+static const int MAX_DEPTH = 3;   // download -> foo.tar -> foo/... -> nested archives
+
+PostProcessor::PostProcessor(QObject* parent)
+    : QObject(parent)
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+PostProcessor::~PostProcessor()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+void PostProcessor::setStages(std::vector<std::shared_ptr<PostStage>> list)
+{
+    stages = std::make_shared<const StageList>(std::move(list));
+}
+
+void PostProcessor::process(int job, const QString& path, const QStringList& skip,
+                            const QStringList& carried)
+{
+    const std::shared_ptr<const StageList> snapshot = stages;
+    const QPointer<PostProcessor> self(this);
+
+    pool.start([self, snapshot, job, path, skip, carried]() {
+        bool allOk = true;
+        QStringList level = { path };
+
+        for (int depth = 0; depth < MAX_DEPTH && !level.isEmpty(); ++depth) {
+            QStringList next = depth == 0 ? carried : QStringList();
+
+            for (const QString& input : std::as_const(level)) {
+                for (const auto& stage : *snapshot) {
+                    if (depth > 0 && !stage->runsOnOutputs()) continue;
+                    if (depth == 0 && skip.contains(stage->name())) continue;
+                    if (!stage->accepts(input)) continue;
+
+                    TRACE_SPAN("post", "stage", job);
+                    QElapsedTimer timer;
+                    timer.start();
+                    const qint64 startedMs = QDateTime::currentMSecsSinceEpoch();
+
+                    StageReport r = stage->run(input);
+                    r.startedMs = startedMs;
+                    r.durationMs = timer.elapsed();
+                    allOk = allOk && r.ok;
+                    next += r.outputs;
+
+                    QMetaObject::invokeMethod(self, [self, job, r]() {
+                        if (self) emit self->stageFinished(job, r);
+                    }, Qt::QueuedConnection);
+                }
+            }
+            level = next;
+        }
+
+        QMetaObject::invokeMethod(self, [self, job, allOk]() {
+            if (self) emit self->finished(job, allOk);
+        }, Qt::QueuedConnection);
+    });
+}
+
+StreamExtractWorker::~StreamExtractWorker()
+{
+    const auto jobs = streams.keys();
+    for (int job : jobs)
+        discard(job);
+}
+
+void StreamExtractWorker::begin(int job, QString inPath)
+{
+    discard(job);
+
+    auto* s = new Stream;
+    s->inPath = inPath;
+    s->outPath = GunzipStage::outputFor(inPath);
+    s->startedMs = QDateTime::currentMSecsSinceEpoch();
+    s->out = new QFile(s->outPath + ".part");
+    if (!s->out->open(QIODevice::WriteOnly))
+        s->error = s->out->errorString();
+    else
+        s->inflater = new GzipStream();
+    streams.insert(job, s);
+}
+
+void StreamExtractWorker::push(Stream* s, const char* data, qint64 len)
+{
+    QByteArray plain;
+    if (!s->inflater->feed(data, len, &plain)) {
+        s->error = s->inflater->errorString();
+        return;
+    }
+    if (s->out->write(plain) != plain.size()) {
+        s->error = s->out->errorString();
+        return;
+    }
+    s->written += plain.size();
+}
+
+void StreamExtractWorker::feed(int job, QByteArray chunk)
+{
+    Stream* s = streams.value(job);
+    if (!s || !s->error.isEmpty() || s->notGzip) return;
+
+    TRACE_SPAN("post", "gunzip-stream", job);
+
+    if (!s->checked) {
+        s->head.append(chunk);
+        if (s->head.size() < 2) return;
+
+        s->checked = true;
+        s->notGzip = !GzipStream::looksCompressed(s->head);
+        if (!s->notGzip)
+            push(s, s->head.constData(), s->head.size());
+        s->head.clear();
+        return;
+    }
+
+    push(s, chunk.constData(), chunk.size());
+}
+
+void StreamExtractWorker::end(int job)
+{
+    Stream* s = streams.value(job);
+    if (!s) return;
+
+    StageReport r;
+    r.stage = "gunzip";
+    r.input = s->inPath;
+    r.startedMs = s->startedMs;
+    r.durationMs = QDateTime::currentMSecsSinceEpoch() - s->startedMs;
+
+    s->out->close();
+    if (s->notGzip || !s->checked) {
+        r.ok = r.skipped = true;
+        r.detail = "not gzip data";
+    } else if (!s->error.isEmpty() || !s->inflater->atEnd()) {
+        r.detail = s->error.isEmpty() ? QString("truncated gzip data") : s->error;
+    } else {
+        QFile::remove(s->outPath);
+        if (s->out->rename(s->outPath)) {
+            r.ok = true;
+            r.outputs << s->outPath;
+            r.detail = QString("streamed, %1 bytes").arg(s->written);
+        } else {
+            r.detail = s->out->errorString();
+        }
+    }
+
+    discard(job);   // removes the .part file unless it was renamed
+    emit streamFinished(job, r);
+}
+
+void StreamExtractWorker::abort(int job)
+{
+    discard(job);
+}
+
+void StreamExtractWorker::discard(int job)
+{
+    Stream* s = streams.take(job);
+    if (!s) return;
+
+    if (s->out->isOpen())
+        s->out->close();
+    if (s->out->fileName().endsWith(".part"))
+        s->out->remove();
+
+    delete s->inflater;
+    delete s->out;
+    delete s;
+}
@@ -0,0 +1,83 @@
+#ifndef POSTPROCESSOR_H
+#define POSTPROCESSOR_H
+
+
+#include <QObject>
+#include <QHash>
+#include <QThreadPool>
+#include <QStringList>
+#include <memory>
+#include <vector>
+
+#include "poststage.h"
+
+class QFile;
+class GzipStream;
+
+// Runs finished downloads through the configured stages on its own thread pool.
+// What a stage produces (e.g. foo.tar out of foo.tgz) is offered to the stages again,
+// a few levels deep. Reports arrive on the owner's thread.
+class PostProcessor : public QObject {
+    Q_OBJECT
+public:
+    explicit PostProcessor(QObject* parent = nullptr);
+    ~PostProcessor() override;
+
+    // Replaces the stage list; jobs already running keep the list they started with.
+    void setStages(std::vector<std::shared_ptr<PostStage>> stages);
+    bool hasStages() const { return !stages->empty(); }
+    void setMaxThreads(int n) { pool.setMaxThreadCount(qMax(1, n)); }
+
+    // skip: stages already done for path (e.g. while streaming); carried: their outputs
+    void process(int job, const QString& path, const QStringList& skip = QStringList(),
+                 const QStringList& carried = QStringList());
+
+signals:
+    void stageFinished(int job, const StageReport& report);
+    void finished(int job, bool ok);
+
+private:
+    using StageList = std::vector<std::shared_ptr<PostStage>>;
+
+    QThreadPool pool;
+    std::shared_ptr<const StageList> stages = std::make_shared<const StageList>();
+};
+
+// Inflates .gz downloads while they arrive, so the compressed bytes are never read
+// back from disk. Lives on its own thread and is fed in network order.
+class StreamExtractWorker : public QObject {
+    Q_OBJECT
+public:
+    explicit StreamExtractWorker(QObject* parent = nullptr) : QObject(parent) {}
+    ~StreamExtractWorker() override;
+
+public slots:
+    void begin(int job, QString inPath);   // output goes where GunzipStage would put it
+    void feed(int job, QByteArray chunk);
+    void end(int job);
+    void abort(int job);   // failed transfer: drop the partial output, report nothing
+
+signals:
+    void streamFinished(int job, StageReport report);
+
+private:
+    struct Stream {
+        QString inPath;
+        QString outPath;
+        QFile* out = nullptr;
+        GzipStream* inflater = nullptr;
+        QByteArray head;        // first bytes, until the magic can be checked
+        bool checked = false;
+        bool notGzip = false;
+        QString error;
+        qint64 startedMs = 0;
+        qint64 written = 0;
+    };
+
+    void push(Stream* s, const char* data, qint64 len);
+    void discard(int job);
+
+    QHash<int, Stream*> streams;
+};
+
+#endif
@@ -0,0 +1,537 @@
+#include "poststage.h"
+#include "blockreader.h"
+#include "gzipstream.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+
+static const qint64 IO_BLOCK = 256 * 1024;
+
+static quint16 le16(const char* p)
+{
+    const uchar* u = reinterpret_cast<const uchar*>(p);
+    return quint16(u[0] | (u[1] << 8));
+}
+
+static quint32 le32(const char* p)
+{
+    return quint32(le16(p)) | (quint32(le16(p + 2)) << 16);
+}
+
+static quint64 le64(const char* p)
+{
+    return quint64(le32(p)) | (quint64(le32(p + 4)) << 32);
+}
+
+static StageReport report(const QString& stage, const QString& input)
+{
+    StageReport r;
+    r.stage = stage;
+    r.input = input;
+    return r;
+}
+
+static QString withoutSuffix(const QString& path, const QString& suffix)
+{
+    return path.left(path.size() - suffix.size());
+}
+
+// -------------------- gunzip --------------------
+bool GunzipStage::accepts(const QString& path) const
+{
+    const QString lower = path.toLower();
+    return lower.endsWith(".gz") || lower.endsWith(".tgz");
+}
+
+QString GunzipStage::outputFor(const QString& path)
+{
+    if (path.endsWith(".tgz", Qt::CaseInsensitive))
+        return withoutSuffix(path, ".tgz") + ".tar";
+    return withoutSuffix(path, ".gz");
+}
+
+StageReport GunzipStage::run(const QString& path) const
+{
+    StageReport r = report(name(), path);
+
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        r.detail = in.errorString();
+        return r;
+    }
+    if (!GzipStream::looksCompressed(in.peek(2))) {
+        r.ok = r.skipped = true;
+        r.detail = "not gzip data";
+        return r;
+    }
+    in.close();
+
+    const QString outPath = outputFor(path);
+    QFile out(outPath + ".part");
+    if (!out.open(QIODevice::WriteOnly)) {
+        r.detail = out.errorString();
+        return r;
+    }
+
+    thread_local BlockReader reader;
+    GzipStream inflater;
+    QByteArray plain;
+    bool failed = false;
+    const bool readOk = reader.read(path, [&](const char* data, qint64 len) {
+        if (failed) return;
+        plain.clear();
+        failed = !inflater.feed(data, len, &plain) || out.write(plain) != plain.size();
+    });
+
+    out.close();
+    if (!readOk || failed || !inflater.atEnd()) {
+        out.remove();
+        r.detail = !readOk ? reader.errorString()
+                 : !inflater.errorString().isEmpty() ? inflater.errorString()
+                 : QString("truncated gzip data");
+        return r;
+    }
+
+    QFile::remove(outPath);
+    if (!out.rename(outPath)) {
+        r.detail = out.errorString();
+        return r;
+    }
+
+    r.ok = true;
+    r.outputs << outPath;
+    r.detail = QString("%1 bytes").arg(QFileInfo(outPath).size());
+    return r;
+}
+
+// -------------------- unzip --------------------
+bool UnzipStage::accepts(const QString& path) const
+{
+    return path.endsWith(".zip", Qt::CaseInsensitive);
+}
+
+StageReport UnzipStage::run(const QString& path) const
+{
+    StageReport r = report(name(), path);
+
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        r.detail = f.errorString();
+        return r;
+    }
+
+    // end of central directory: last 22 bytes plus up to 64 KiB of comment
+    const qint64 size = f.size();
+    const qint64 tailLen = qMin<qint64>(size, 22 + 0xffff);
+    f.seek(size - tailLen);
+    const QByteArray tail = f.read(tailLen);
+
+    int eocd = -1;
+    for (int i = tail.size() - 22; i >= 0; --i) {
+        if (le32(tail.constData() + i) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        r.detail = "not a zip archive";
+        return r;
+    }
+
+    const char* e = tail.constData() + eocd;
+    quint64 entries = le16(e + 10);
+    quint64 cdSize = le32(e + 12);
+    quint64 cdOffset = le32(e + 16);
+
+    // zip64: the locator sits right in front of the classic record
+    if (eocd >= 20 && le32(e - 20) == 0x07064b50) {
+        f.seek(qint64(le64(e - 20 + 8)));
+        const QByteArray z64 = f.read(56);
+        if (z64.size() == 56 && le32(z64.constData()) == 0x06064b50) {
+            entries = le64(z64.constData() + 32);
+            cdSize = le64(z64.constData() + 40);
+            cdOffset = le64(z64.constData() + 48);
+        }
+    }
+
+    f.seek(qint64(cdOffset));
+    const QByteArray cd = f.read(qint64(cdSize));
+    if (quint64(cd.size()) != cdSize) {
+        r.detail = "truncated central directory";
+        return r;
+    }
+
+    const QString root = withoutSuffix(path, ".zip");
+    const QDir dest(root);
+    if (!dest.mkpath(".")) {
+        r.detail = "cannot create " + root;
+        return r;
+    }
+
+    int files = 0;
+    QStringList problems;
+    int pos = 0;
+    for (quint64 n = 0; n < entries; ++n) {
+        if (pos + 46 > cd.size() || le32(cd.constData() + pos) != 0x02014b50) {
+            problems << "corrupt central directory";
+            break;
+        }
+
+        const char* h = cd.constData() + pos;
+        const quint16 flags = le16(h + 8);
+        const quint16 method = le16(h + 10);
+        const quint32 crc = le32(h + 16);
+        quint64 csize = le32(h + 20);
+        quint64 usize = le32(h + 24);
+        const int nameLen = le16(h + 28);
+        const int extraLen = le16(h + 30);
+        const int commentLen = le16(h + 32);
+        quint64 localOffset = le32(h + 42);
+
+        if (pos + 46 + nameLen + extraLen > cd.size()) {
+            problems << "corrupt central directory";
+            break;
+        }
+
+        const QByteArray rawName(h + 46, nameLen);
+        const QString name = (flags & 0x800) ? QString::fromUtf8(rawName) : QString::fromLatin1(rawName);
+
+        // zip64 extra field: only the values saturated in the header are present, in this order
+        for (int x = 0; x + 4 <= extraLen; ) {
+            const char* field = h + 46 + nameLen + x;
+            const int id = le16(field);
+            const int len = le16(field + 2);
+            if (id == 0x0001) {
+                const char* v = field + 4;
+                const char* end = v + len;
+                if (usize == 0xffffffff && v + 8 <= end) { usize = le64(v); v += 8; }
+                if (csize == 0xffffffff && v + 8 <= end) { csize = le64(v); v += 8; }
+                if (localOffset == 0xffffffff && v + 8 <= end) { localOffset = le64(v); }
+            }
+            x += 4 + len;
+        }
+        pos += 46 + nameLen + extraLen + commentLen;
+
+        const QString rel = QDir::cleanPath(QString(name).replace('\\', '/'));
+        if (rel.isEmpty() || rel == ".." || rel.startsWith("../") || QDir::isAbsolutePath(rel) || rel.contains(':')) {
+            problems << "unsafe path " + name;
+            continue;
+        }
+        if (name.endsWith('/')) {
+            dest.mkpath(rel);
+            continue;
+        }
+        if (flags & 0x1) {
+            problems << "encrypted " + name;
+            continue;
+        }
+        if (method != 0 && method != 8) {
+            problems << QString("method %1 for %2").arg(method).arg(name);
+            continue;
+        }
+
+        // the local header repeats name and extra with possibly different lengths
+        char local[30];
+        if (!f.seek(qint64(localOffset)) || f.read(local, 30) != 30 || le32(local) != 0x04034b50) {
+            problems << "bad local header for " + name;
+            continue;
+        }
+        const qint64 dataStart = qint64(localOffset) + 30 + le16(local + 26) + le16(local + 28);
+
+        const QString outPath = dest.filePath(rel);
+        dest.mkpath(QFileInfo(rel).path());
+        QFile out(outPath);
+        if (!f.seek(dataStart) || !out.open(QIODevice::WriteOnly)) {
+            problems << "cannot write " + rel;
+            continue;
+        }
+
+        GzipStream inflater(GzipStream::RawDeflate);
+        QByteArray plain;
+        uLong sum = crc32(0, nullptr, 0);
+        quint64 written = 0;
+        quint64 left = csize;
+        bool ok = true;
+        while (ok && left > 0) {
+            const QByteArray block = f.read(qint64(qMin<quint64>(left, IO_BLOCK)));
+            if (block.isEmpty()) {
+                ok = false;
+                break;
+            }
+            left -= quint64(block.size());
+
+            const QByteArray* data = &block;
+            if (method == 8) {
+                plain.clear();
+                ok = inflater.feed(block, &plain);
+                data = &plain;
+            }
+            sum = crc32(sum, reinterpret_cast<const Bytef*>(data->constData()), uInt(data->size()));
+            written += quint64(data->size());
+            ok = ok && out.write(*data) == data->size();
+        }
+        out.close();
+
+        if (!ok || written != usize || quint32(sum) != crc) {
+            out.remove();
+            problems << "corrupt member " + name;
+            continue;
+        }
+
+        r.outputs << outPath;
+        files++;
+    }
+
+    r.ok = problems.isEmpty();
+    r.detail = QString("%1 file(s)").arg(files);
+    if (!problems.isEmpty())
+        r.detail += "; " + problems.mid(0, 3).join(", ") + (problems.size() > 3 ? ", ..." : "");
+    return r;
+}
+
+// -------------------- untar --------------------
+static const int TAR_BLOCK = 512;
+static const qint64 TAR_MAX_META = 1024 * 1024;   // PAX / GNU long-name data, read whole
+
+// numeric header field: octal, or GNU base-256 (high bit set) for sizes past 8 GiB
+static qint64 tarNumber(const char* field, int width)
+{
+    const uchar* u = reinterpret_cast<const uchar*>(field);
+    if (u[0] & 0x80) {
+        qint64 value = u[0] & 0x3f;
+        for (int i = 1; i < width; ++i)
+            value = (value << 8) | u[i];
+        return value;
+    }
+
+    qint64 value = 0;
+    int i = 0;
+    while (i < width && (field[i] == ' ' || field[i] == '\0'))
+        ++i;
+    for (; i < width && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+// the checksum field counts as spaces; some old writers summed signed chars
+static bool tarChecksumOk(const char* h)
+{
+    qint64 unsignedSum = 0, signedSum = 0;
+    for (int i = 0; i < TAR_BLOCK; ++i) {
+        const bool field = i >= 148 && i < 156;
+        unsignedSum += field ? ' ' : uchar(h[i]);
+        signedSum += field ? ' ' : qint8(h[i]);
+    }
+    const qint64 stored = tarNumber(h + 148, 8);
+    return stored == unsignedSum || stored == signedSum;
+}
+
+static QByteArray tarString(const char* field, int width)
+{
+    const void* nul = memchr(field, '\0', size_t(width));
+    return QByteArray(field, nul ? int(static_cast<const char*>(nul) - field) : width);
+}
+
+// PAX extended header: "<length> <key>=<value>\n" records
+static QByteArray paxValue(const QByteArray& records, const QByteArray& key)
+{
+    int pos = 0;
+    while (pos < records.size()) {
+        const int space = records.indexOf(' ', pos);
+        const int len = space < 0 ? 0 : records.mid(pos, space - pos).toInt();
+        if (len <= 0 || pos + len > records.size())
+            break;
+        const QByteArray record = records.mid(space + 1, pos + len - space - 2);   // without '\n'
+        if (record.startsWith(key + '='))
+            return record.mid(key.size() + 1);
+        pos += len;
+    }
+    return QByteArray();
+}
+
+bool UntarStage::accepts(const QString& path) const
+{
+    return path.endsWith(".tar", Qt::CaseInsensitive);
+}
+
+StageReport UntarStage::run(const QString& path) const
+{
+    StageReport r = report(name(), path);
+
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        r.detail = in.errorString();
+        return r;
+    }
+
+    const QString root = withoutSuffix(path, ".tar");
+    const QDir dest(root);
+    if (!dest.mkpath(".")) {
+        r.detail = "cannot create " + root;
+        return r;
+    }
+
+    QStringList problems;
+    int files = 0;
+    int skipped = 0;
+    QByteArray longName;   // GNU 'L' or PAX path for the member that follows
+    qint64 paxSize = -1;   // PAX size for the member that follows
+    QByteArray buffer(int(IO_BLOCK), Qt::Uninitialized);
+    char h[TAR_BLOCK];
+
+    while (true) {
+        const qint64 got = in.read(h, TAR_BLOCK);
+        if (got == 0)
+            break;   // no end-of-archive blocks: tolerated, like GNU tar does
+        if (got != TAR_BLOCK) {
+            problems << "truncated archive";
+            break;
+        }
+        if (std::all_of(h, h + TAR_BLOCK, [](char c) { return c == '\0'; }))
+            break;
+        if (!tarChecksumOk(h)) {
+            problems << QString("bad header checksum at offset %1").arg(in.pos() - TAR_BLOCK);
+            break;
+        }
+
+        const char type = h[156];
+        qint64 size = tarNumber(h + 124, 12);
+        const bool meta = type == 'L' || type == 'K' || type == 'x' || type == 'g';
+        if (!meta && paxSize >= 0)
+            size = paxSize;
+        const qint64 next = in.pos() + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+
+        if (type == 'L' || type == 'x') {
+            if (size > TAR_MAX_META) {
+                problems << "oversized extended header";
+                break;
+            }
+            const QByteArray data = in.read(size);
+            if (data.size() != size) {
+                problems << "truncated archive";
+                break;
+            }
+            if (type == 'L') {
+                longName = tarString(data.constData(), data.size());
+            } else {
+                const QByteArray paxPath = paxValue(data, "path");
+                if (!paxPath.isEmpty()) longName = paxPath;
+                const QByteArray paxSizeValue = paxValue(data, "size");
+                if (!paxSizeValue.isEmpty()) paxSize = paxSizeValue.toLongLong();
+            }
+        }
+        if (meta) {
+            if (!in.seek(next)) break;
+            continue;
+        }
+
+        QByteArray rawName = longName;
+        longName.clear();
+        paxSize = -1;
+        if (rawName.isEmpty()) {
+            rawName = tarString(h, 100);
+            // POSIX ustar only: GNU tar keeps other fields where the prefix would be
+            if (memcmp(h + 257, "ustar\0", 6) == 0) {
+                const QByteArray prefix = tarString(h + 345, 155);
+                if (!prefix.isEmpty()) rawName = prefix + '/' + rawName;
+            }
+        }
+
+        const QString name = QString::fromUtf8(rawName);
+        const QString rel = QDir::cleanPath(QString(name).replace('\\', '/'));
+        const bool safe = !rel.isEmpty() && rel != ".." && !rel.startsWith("../")
+                          && !QDir::isAbsolutePath(rel) && !rel.contains(':');
+
+        if (type == '5') {
+            if (!safe)
+                problems << "unsafe path " + name;
+            else if (rel != "." && !dest.mkpath(rel))
+                problems << "cannot create " + rel;
+        } else if (type == '0' || type == '\0' || type == '7') {
+            const QString outPath = dest.filePath(rel);
+            QFile out(outPath);
+            if (!safe || rel == ".") {
+                problems << "unsafe path " + name;
+            } else if (!dest.mkpath(QFileInfo(rel).path()) || !out.open(QIODevice::WriteOnly)) {
+                problems << "cannot write " + rel;
+            } else {
+                bool truncated = false;
+                bool ok = true;
+                for (qint64 left = size; ok && left > 0; ) {
+                    const qint64 n = in.read(buffer.data(), qMin(left, IO_BLOCK));
+                    truncated = n <= 0;
+                    ok = !truncated && out.write(buffer.constData(), n) == n;
+                    left -= n;
+                }
+                ok = ok && out.flush();
+                out.close();
+
+                if (!ok) {
+                    out.remove();
+                    problems << (truncated ? "truncated member " + name : "cannot write " + rel);
+                    if (truncated) break;
+                } else {
+                    r.outputs << outPath;
+                    files++;
+                }
+            }
+        } else {
+            skipped++;   // links, devices, FIFOs
+        }
+
+        if (!in.seek(next))
+            break;
+    }
+
+    r.ok = problems.isEmpty();
+    r.detail = QString("%1 file(s)").arg(files);
+    if (skipped > 0)
+        r.detail += QString(", %1 link/special entr%2 skipped").arg(skipped).arg(skipped == 1 ? "y" : "ies");
+    if (!problems.isEmpty())
+        r.detail += "; " + problems.mid(0, 3).join(", ") + (problems.size() > 3 ? ", ..." : "");
+    return r;
+}
+
+// -------------------- command hook --------------------
+StageReport CommandStage::run(const QString& path) const
+{
+    StageReport r = report(name(), path);
+
+    QStringList args = QProcess::splitCommand(command);
+    if (args.isEmpty()) {
+        r.ok = r.skipped = true;
+        return r;
+    }
+    for (QString& a : args)
+        a.replace("{file}", path);
+    const QString program = args.takeFirst();
+
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.setWorkingDirectory(QFileInfo(path).absolutePath());
+    p.start(program, args);
+    if (!p.waitForStarted()) {
+        r.detail = p.errorString();
+        return r;
+    }
+    if (!p.waitForFinished(timeoutSec * 1000)) {
+        p.kill();
+        p.waitForFinished();
+        r.detail = QString("timed out after %1s").arg(timeoutSec);
+        return r;
+    }
+
+    const QString lastLine = QString::fromLocal8Bit(p.readAll()).trimmed().section('\n', -1).left(200);
+    r.ok = p.exitStatus() == QProcess::NormalExit && p.exitCode() == 0;
+    r.detail = QString("exit %1").arg(p.exitCode());
+    if (!lastLine.isEmpty())
+        r.detail += ": " + lastLine;
+    return r;
+}
@@ -0,0 +1,77 @@
+#ifndef POSTSTAGE_H
+#define POSTSTAGE_H
+
+
+#include <QString>
+#include <QStringList>
+#include <QMetaType>
+
+struct StageReport {
+    QString stage;
+    QString input;
+    bool ok = false;
+    bool skipped = false;     // input turned out not to be for this stage
+    QString detail;
+    QStringList outputs;      // files produced; offered to the stages again
+    qint64 startedMs = 0;     // epoch ms
+    qint64 durationMs = 0;
+};
+Q_DECLARE_METATYPE(StageReport)
+
+// One post-download step. run() is called on pool threads, possibly for several files
+// at once, so a stage keeps no per-file state.
+class PostStage {
+public:
+    virtual ~PostStage() = default;
+
+    virtual QString name() const = 0;
+    virtual bool accepts(const QString& path) const = 0;
+    virtual StageReport run(const QString& path) const = 0;
+
+    // false: only the downloaded file itself is handed to this stage
+    virtual bool runsOnOutputs() const { return true; }
+};
+
+// foo.gz -> foo, foo.tgz -> foo.tar. Also fed straight from the network, see StreamExtractWorker.
+class GunzipStage : public PostStage {
+public:
+    QString name() const override { return "gunzip"; }
+    bool accepts(const QString& path) const override;
+    StageReport run(const QString& path) const override;
+
+    static QString outputFor(const QString& path);
+};
+
+// foo.zip -> foo/... : stored and deflated members, zip64, CRC-checked. Members that
+// would land outside foo/ are refused.
+class UnzipStage : public PostStage {
+public:
+    QString name() const override { return "unzip"; }
+    bool accepts(const QString& path) const override;
+    StageReport run(const QString& path) const override;
+};
+
+// foo.tar -> foo/... (ustar, PAX and GNU long names; members streamed to disk)
+class UntarStage : public PostStage {
+public:
+    QString name() const override { return "untar"; }
+    bool accepts(const QString& path) const override;
+    StageReport run(const QString& path) const override;
+};
+
+// User hook: runs command with every "{file}" replaced by the downloaded path.
+class CommandStage : public PostStage {
+public:
+    CommandStage(const QString& command, int timeoutSec) : command(command), timeoutSec(timeoutSec) {}
+
+    QString name() const override { return "command"; }
+    bool accepts(const QString&) const override { return !command.trimmed().isEmpty(); }
+    StageReport run(const QString& path) const override;
+    bool runsOnOutputs() const override { return false; }
+
+private:
+    QString command;
+    int timeoutSec;
+};
+
+#endif
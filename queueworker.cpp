@@ -0,0 +1,256 @@
+#include "queueworker.h"
+#include "filewriter.h"
+#include "hasher.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSysInfo>
+#include <QDebug>
+
+QueueWorker::QueueWorker(const Options& options, QObject* parent)
+    : QObject(parent)
+    , opt(options)
+{
+}
+
+QueueWorker::~QueueWorker()
+{
+    for (auto it = jobs.begin(); it != jobs.end(); ++it)
+        if (it->reply) it->reply->abort();
+
+    writerThread.quit();
+    writerThread.wait();
+    hashThread.quit();
+    hashThread.wait();
+}
+
+QString QueueWorker::defaultWorkerId()
+{
+    return QSysInfo::machineHostName() + ":" + QString::number(QCoreApplication::applicationPid());
+}
+
+bool QueueWorker::start(QString* error)
+{
+    if (!db.openAtPath(opt.dbPath, opt.rollbackJournal)) {
+        *error = "cannot open " + opt.dbPath
+                 + (opt.rollbackJournal ? " with a rollback journal" : " in WAL mode");
+        return false;
+    }
+    if (opt.workerId.isEmpty())
+        opt.workerId = defaultWorkerId();
+    if (!opt.downloadDir.isEmpty())
+        QDir().mkpath(opt.downloadDir);
+
+    writerThread.setObjectName("writer");
+    writer = new FileWriterWorker();
+    writer->moveToThread(&writerThread);
+    connect(&writerThread, &QThread::finished, writer, &QObject::deleteLater);
+
+    connect(this, &QueueWorker::requestOpenFile,    writer, &FileWriterWorker::openFile,    Qt::QueuedConnection);
+    connect(this, &QueueWorker::requestAppendChunk, writer, &FileWriterWorker::appendChunk, Qt::QueuedConnection);
+    connect(this, &QueueWorker::requestCloseFile,   writer, &FileWriterWorker::closeFile,   Qt::QueuedConnection);
+    connect(this, &QueueWorker::requestAbortFile,   writer, &FileWriterWorker::abortFile,   Qt::QueuedConnection);
+    connect(writer, &FileWriterWorker::fileClosed, this, &QueueWorker::onFileClosed,  Qt::QueuedConnection);
+    connect(writer, &FileWriterWorker::writeError, this, &QueueWorker::onWriterError, Qt::QueuedConnection);
+    writerThread.start();
+
+    hashThread.setObjectName("hasher");
+    hasher = new HasherWorker();
+    hasher->moveToThread(&hashThread);
+    connect(&hashThread, &QThread::finished, hasher, &QObject::deleteLater);
+
+    connect(this, &QueueWorker::requestHash, hasher, &HasherWorker::hashFile, Qt::QueuedConnection);
+    connect(hasher, &HasherWorker::hashReady, this, &QueueWorker::onHashReady, Qt::QueuedConnection);
+    connect(hasher, &HasherWorker::hashError, this, &QueueWorker::onHashError, Qt::QueuedConnection);
+    hashThread.start();
+
+    claimTimer.setInterval(1000);
+    connect(&claimTimer, &QTimer::timeout, this, &QueueWorker::tick);
+    claimTimer.start();
+
+    // renew well before expiry so one slow DB write does not cost the lease
+    heartbeatTimer.setInterval(qMax(1, opt.leaseSecs / 3) * 1000);
+    connect(&heartbeatTimer, &QTimer::timeout, this, &QueueWorker::heartbeat);
+    heartbeatTimer.start();
+
+    qInfo().noquote() << "worker" << opt.workerId << "on" << opt.dbPath;
+    QTimer::singleShot(0, this, &QueueWorker::tick);
+    return true;
+}
+
+void QueueWorker::heartbeat()
+{
+    if (jobs.isEmpty())
+        return;
+
+    QSet<QString> owned;
+    if (!db.renewLeases(opt.workerId, opt.leaseSecs, &owned))
+        return;   // DB busy: try again on the next beat, the lease may still hold
+
+    // stalled past the lease and someone else took over: stop touching their file and row
+    const auto keys = jobs.keys();
+    for (int key : keys) {
+        const Job& job = jobs[key];
+        if (!owned.contains(job.claim.url + '\n' + job.claim.filePath))
+            dropLost(key);
+    }
+}
+
+void QueueWorker::dropLost(int key)
+{
+    const Job job = jobs.take(key);
+    if (job.reply)
+        job.reply->abort();   // finished() finds no job any more
+    emit requestAbortFile(key);
+    qWarning().noquote() << "lost lease" << job.claim.url;
+}
+
+void QueueWorker::tick()
+{
+    const int free = opt.concurrency - jobs.size();
+    if (free > 0) {
+        const QVector<ClaimedJob> claimed = db.claimJobs(opt.workerId, free, opt.leaseSecs);
+        for (const ClaimedJob& c : claimed)
+            startJob(c);
+    }
+
+    // deferred retries and other workers' leases can still come back to the queue
+    if (opt.exitWhenIdle && jobs.isEmpty() && db.pendingShared() == 0)
+        emit idle();
+}
+
+void QueueWorker::startJob(const ClaimedJob& claim)
+{
+    Job job;
+    job.claim = claim;
+
+    // another machine may have published it with a path that does not exist here
+    job.path = claim.filePath;
+    if (!QFileInfo(QFileInfo(job.path).absolutePath()).isWritable() && !opt.downloadDir.isEmpty())
+        job.path = QDir(opt.downloadDir).filePath(claim.fileName);
+
+    const int key = nextKey++;
+    db.updateStatus(claim.url, claim.filePath, "Downloading (" + opt.workerId + ")", opt.workerId);
+    emit requestOpenFile(key, job.path);
+
+    QNetworkRequest req((QUrl(claim.url)));
+    req.setTransferTimeout(30000);   // stalled transfers fail and go back to the queue
+    job.reply = net.get(req);
+    jobs.insert(key, job);
+
+    QNetworkReply* reply = job.reply;
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply, key]() {
+        const QByteArray chunk = reply->readAll();
+        if (!chunk.isEmpty())
+            emit requestAppendChunk(key, chunk);
+    });
+    connect(reply, &QNetworkReply::downloadProgress, this, [this, key](qint64 rec, qint64 tot) {
+        auto it = jobs.find(key);
+        if (it == jobs.end() || tot <= 0) return;
+
+        // whole-percent steps keep the shared DB's write lock free for the others
+        const int percent = int(rec * 100 / tot);
+        if (percent == it->lastPercent) return;
+        it->lastPercent = percent;
+        db.updateProgress(it->claim.url, it->claim.filePath, percent, opt.workerId);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { onReplyFinished(reply); });
+}
+
+void QueueWorker::onReplyFinished(QNetworkReply* reply)
+{
+    reply->deleteLater();
+
+    int key = -1;
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (it->reply == reply) {
+            key = it.key();
+            it->reply = nullptr;
+            break;
+        }
+    }
+    if (key < 0) return;
+
+    const Job& job = jobs[key];
+    const QByteArray last = reply->readAll();
+    if (!last.isEmpty())
+        emit requestAppendChunk(key, last);
+
+    if (reply->error() == QNetworkReply::NoError) {
+        if (!db.updateStatus(job.claim.url, job.claim.filePath, "Downloaded (hashing...)", opt.workerId)) {
+            dropLost(key);
+            return;
+        }
+        emit requestCloseFile(key);
+        return;
+    }
+
+    emit requestAbortFile(key);
+
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (retryPolicy.classify(reply->error(), httpStatus) == RetryPolicy::Verdict::Retry
+        && job.claim.claims < retryPolicy.maxAttempts) {
+        int delay = retryPolicy.retryAfterMs(reply);
+        if (delay < 0) delay = retryPolicy.backoffMs(job.claim.claims);
+        db.deferJob(job.claim.url, job.claim.filePath, opt.workerId, delay,
+                    "Retrying: " + reply->errorString());
+        jobs.remove(key);
+        return;
+    }
+
+    finish(key, "Error: " + reply->errorString());
+}
+
+void QueueWorker::onFileClosed(int key)
+{
+    auto it = jobs.find(key);
+    if (it == jobs.end()) return;
+    emit requestHash(key, it->path);
+}
+
+void QueueWorker::onHashReady(int key, const QString& digestHex)
+{
+    auto it = jobs.find(key);
+    if (it == jobs.end()) return;
+
+    if (!db.setHashAndDone(it->claim.url, it->claim.filePath, digestHex, opt.workerId)) {
+        qWarning().noquote() << "lost lease before recording" << it->claim.url;
+        jobs.erase(it);
+        return;
+    }
+    db.releaseLease(it->claim.url, it->claim.filePath, opt.workerId);
+    qInfo().noquote() << "done" << it->claim.url << digestHex.left(12);
+    jobs.erase(it);
+}
+
+void QueueWorker::onHashError(int key, const QString& message)
+{
+    finish(key, "Done (hash error: " + message + ")");
+}
+
+void QueueWorker::onWriterError(int key, const QString& message)
+{
+    auto it = jobs.find(key);
+    if (it == jobs.end()) return;
+    if (it->reply) {
+        QNetworkReply* r = it->reply;
+        it->reply = nullptr;
+        r->abort();
+    }
+    finish(key, "Error: " + message);
+}
+
+void QueueWorker::finish(int key, const QString& status)
+{
+    auto it = jobs.find(key);
+    if (it == jobs.end()) return;
+
+    // a no-op once the lease is gone: the new owner's status stands
+    db.updateStatus(it->claim.url, it->claim.filePath, status, opt.workerId);
+    db.releaseLease(it->claim.url, it->claim.filePath, opt.workerId);
+    qInfo().noquote() << status << it->claim.url;
+    jobs.erase(it);
+}
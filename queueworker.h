@@ -0,0 +1,89 @@
+#ifndef QUEUEWORKER_H
+#define QUEUEWORKER_H
+
+
+#include <QObject>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QThread>
+#include <QTimer>
+
+#include "dbmanager.h"
+#include "retrypolicy.h"
+
+class QNetworkReply;
+class FileWriterWorker;
+class HasherWorker;
+
+// Headless downloader for `--worker`: claims jobs from the shared queue in the DB,
+// downloads, hashes and reports them back into the same downloads table. Any number
+// of these (and GUIs in shared-queue mode) can work one DB; a worker that dies just
+// stops renewing its leases and its jobs go to the others.
+class QueueWorker : public QObject {
+    Q_OBJECT
+public:
+    struct Options {
+        QString dbPath;
+        QString downloadDir;      // used when the job's own path is not writable from here
+        QString workerId;
+        int concurrency = 8;
+        int leaseSecs = 60;
+        bool exitWhenIdle = false;
+        bool rollbackJournal = false;
+    };
+
+    explicit QueueWorker(const Options& options, QObject* parent = nullptr);
+    ~QueueWorker() override;
+
+    bool start(QString* error);
+
+    static QString defaultWorkerId();
+
+signals:
+    void requestOpenFile(int job, QString path);
+    void requestAppendChunk(int job, QByteArray chunk);
+    void requestCloseFile(int job);
+    void requestAbortFile(int job);
+    void requestHash(int job, QString filePath);
+
+    void idle();   // no unfinished shared job left and nothing in flight (exitWhenIdle)
+
+private slots:
+    void tick();
+    void heartbeat();
+    void onFileClosed(int job);
+    void onHashReady(int job, const QString& digestHex);
+    void onHashError(int job, const QString& message);
+    void onWriterError(int job, const QString& message);
+
+private:
+    struct Job {
+        ClaimedJob claim;
+        QString path;            // where it is written on this machine
+        QNetworkReply* reply = nullptr;
+        int lastPercent = -1;
+    };
+
+    void startJob(const ClaimedJob& claim);
+    void onReplyFinished(QNetworkReply* reply);
+    void finish(int key, const QString& status);
+    void dropLost(int key);   // another worker owns the job now
+
+    Options opt;
+    DBManager db;
+    QNetworkAccessManager net;
+    RetryPolicy retryPolicy;
+
+    QThread writerThread;
+    FileWriterWorker* writer = nullptr;
+    QThread hashThread;
+    HasherWorker* hasher = nullptr;
+
+    QHash<int, Job> jobs;   // local key -> job (the writer and hasher key by int)
+    int nextKey = 0;
+
+    QTimer claimTimer;
+    QTimer heartbeatTimer;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "retentionworker.h"
+#include "tracer.h"
+
+namespace {
+
+const int STEP_PAUSE_MS = 100;     // lets queued download writes through between batches
+const int VACUUM_PAGES = 256;      // pages handed back per batch (1 MiB at 4 KiB pages)
+const int CHECKPOINT_MS = 60000;
+
+} // namespace
+
+RetentionWorker::RetentionWorker(QObject* parent)
+    : QObject(parent)
+    , runTimer(this)
+    , stepTimer(this)
+    , checkpointTimer(this)
+{
+    stepTimer.setSingleShot(true);
+    stepTimer.setInterval(STEP_PAUSE_MS);
+    connect(&stepTimer, &QTimer::timeout, this, &RetentionWorker::step);
+
+    connect(&runTimer, &QTimer::timeout, this, &RetentionWorker::runNow);
+
+    checkpointTimer.setInterval(CHECKPOINT_MS);
+    connect(&checkpointTimer, &QTimer::timeout, this, [this]() {
+        if (opened && !running) db.checkpoint();
+    });
+}
+
+void RetentionWorker::open(QString dbPath, bool rollbackJournal)
+{
+    // the connection belongs to this thread, so it is opened here and not by the GUI
+    opened = db.openAtPath(dbPath, rollbackJournal);
+    if (!opened) {
+        emit failed("retention: cannot open " + dbPath);
+        return;
+    }
+    checkpointTimer.start();
+}
+
+void RetentionWorker::setPolicy(RetentionPolicy p, int intervalMin)
+{
+    policy = p;
+    if (intervalMin > 0)
+        runTimer.start(intervalMin * 60000);
+    else
+        runTimer.stop();
+}
+
+void RetentionWorker::runNow()
+{
+    if (!opened || running) return;
+    running = true;
+    archived = 0;
+    lastFreeBytes = -1;
+    step();
+}
+
+void RetentionWorker::step()
+{
+    TRACE_SPAN("db", "retention.step", -1);
+
+    const int n = db.archiveBatch(policy);
+    if (n < 0) {
+        running = false;
+        emit failed("retention: archiving failed, will try again on the next pass");
+        return;
+    }
+
+    archived += n;
+    db.incrementalVacuum(VACUUM_PAGES);
+
+    if (n >= qMax(1, policy.batchRows)) {
+        stepTimer.start();   // probably more to go
+        return;
+    }
+
+    // nothing left to archive: keep handing back free pages, a slice per step, until
+    // the freelist is empty or stops shrinking (auto_vacuum off, or a reader holds it)
+    const DbStats stats = db.stats();
+    if (stats.incrementalVacuum && stats.freeBytes > 0
+        && (lastFreeBytes < 0 || stats.freeBytes < lastFreeBytes)) {
+        lastFreeBytes = stats.freeBytes;
+        stepTimer.start();
+        return;
+    }
+
+    db.checkpoint();
+    running = false;
+    emit report(db.stats(), archived);
+}
+
+void RetentionWorker::compactNow()
+{
+    if (!opened || running) return;
+
+    // blocks writers for as long as it runs; only ever started by hand
+    if (!db.compact()) {
+        emit failed("retention: compaction failed (database busy?)");
+        return;
+    }
+    emit report(db.stats(), 0);
+}
+
+void RetentionWorker::refreshStats()
+{
+    if (!opened) return;
+    emit report(db.stats(), 0);
+}
@@ -0,0 +1,47 @@
+#ifndef RETENTIONWORKER_H
+#define RETENTIONWORKER_H
+
+
+#include <QObject>
+#include <QTimer>
+
+#include "dbmanager.h"
+
+// Keeps the history DB bounded on its own thread and connection: moves old rows into
+// downloads_archive one small batch at a time, hands freed pages back with incremental
+// vacuum between batches and runs passive WAL checkpoints, so downloads writing to the
+// same file only ever wait for one short transaction.
+class RetentionWorker : public QObject {
+    Q_OBJECT
+public:
+    explicit RetentionWorker(QObject* parent = nullptr);
+
+public slots:
+    void open(QString dbPath, bool rollbackJournal);   // same journal mode as every other connection
+    // intervalMin = 0 only runs on runNow()
+    void setPolicy(RetentionPolicy policy, int intervalMin);
+    void runNow();
+    void compactNow();
+    void refreshStats();
+
+signals:
+    void report(DbStats stats, qint64 archived);   // after a pass, compaction or refreshStats()
+    void failed(QString message);
+
+private slots:
+    void step();
+
+private:
+    DBManager db;
+    bool opened = false;
+    RetentionPolicy policy;
+
+    QTimer runTimer;          // next scheduled pass
+    QTimer stepTimer;         // pause between batches of one pass
+    QTimer checkpointTimer;
+    bool running = false;
+    qint64 archived = 0;      // rows moved by the current pass
+    qint64 lastFreeBytes = -1;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "retrypolicy.h"
+
+#include <QDateTime>
+#include <QRandomGenerator>
+#include <QtMath>
+
+RetryPolicy::Verdict RetryPolicy::classify(QNetworkReply::NetworkError error, int httpStatus) const
+{
+    if (httpStatus > 0) {
+        switch (httpStatus) {
+        case 408: case 425: case 429:
+        case 500: case 502: case 503: case 504:
+            return Verdict::Retry;
+        default:
+            break;
+        }
+        if (httpStatus >= 400 && httpStatus < 500) return Verdict::Fatal;
+        if (httpStatus == 501 || httpStatus == 505) return Verdict::Fatal;
+        if (httpStatus >= 500) return Verdict::Retry;
+    }
+
+    switch (error) {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyConnectionRefusedError:
+    case QNetworkReply::ProxyConnectionClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::InternalServerError:
+    case QNetworkReply::ServiceUnavailableError:
+    case QNetworkReply::UnknownServerError:
+    case QNetworkReply::ProtocolFailure:
+        return Verdict::Retry;
+    default:
+        return Verdict::Fatal;
+    }
+}
+
+int RetryPolicy::backoffMs(int attempt) const
+{
+    const int exp = qBound(0, attempt - 1, 20);
+    const qint64 cap = qMin<qint64>(maxDelayMs, qint64(baseDelayMs) << exp);
+
+    // Half fixed, half random: spreads a burst of failures without ever retrying instantly.
+    const qint64 half = cap / 2;
+    return int(half + QRandomGenerator::global()->bounded(half + 1));
+}
+
+int RetryPolicy::retryAfterMs(const QNetworkReply* reply) const
+{
+    if (!reply) return -1;
+
+    const QString value = QString::fromLatin1(reply->rawHeader("Retry-After")).trimmed();
+    if (value.isEmpty()) return -1;
+
+    bool ok = false;
+    const qint64 secs = value.toLongLong(&ok);
+    if (ok)
+        return int(qBound<qint64>(0, secs * 1000, maxRetryAfterMs));
+
+    QDateTime when = QDateTime::fromString(value, Qt::RFC2822Date);
+    if (!when.isValid() && value.endsWith("GMT"))
+        when = QDateTime::fromString(value.chopped(3) + "+0000", Qt::RFC2822Date);
+    if (!when.isValid()) return -1;
+
+    const qint64 delta = QDateTime::currentDateTimeUtc().msecsTo(when);
+    return int(qBound<qint64>(0, delta, maxRetryAfterMs));
+}
+
+bool RetryPolicy::isCongestionSignal(QNetworkReply::NetworkError error, int httpStatus)
+{
+    if (httpStatus == 429 || httpStatus == 503) return true;
+    return error == QNetworkReply::TimeoutError
+        || error == QNetworkReply::ServiceUnavailableError;
+}
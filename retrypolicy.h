@@ -0,0 +1,29 @@
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+
+#include <QNetworkReply>
+
+// Decides whether a failed transfer is worth another attempt and how long to wait before it.
+class RetryPolicy {
+public:
+    enum class Verdict { Retry, Fatal };
+
+    int maxAttempts = 5;
+    int baseDelayMs = 1000;
+    int maxDelayMs  = 60000;
+    int maxRetryAfterMs = 10 * 60 * 1000;
+
+    Verdict classify(QNetworkReply::NetworkError error, int httpStatus) const;
+
+    // Exponential backoff with jitter; attempt is 1-based.
+    int backoffMs(int attempt) const;
+
+    // Delay requested by the server via Retry-After (seconds or HTTP-date), -1 if absent.
+    int retryAfterMs(const QNetworkReply* reply) const;
+
+    // 429/503/timeouts: the host wants us to slow down, not just try again.
+    static bool isCongestionSignal(QNetworkReply::NetworkError error, int httpStatus);
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "sitemapcrawler.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+SitemapCrawler::SitemapCrawler(QNetworkAccessManager* net, QObject* parent)
+    : QObject(parent)
+    , net(net)
+{
+}
+
+SitemapCrawler::~SitemapCrawler()
+{
+    abort();
+}
+
+void SitemapCrawler::start(const QUrl& url)
+{
+    abort();
+
+    site = url;
+    explicitSitemap = QUrl();
+    rules.clear();
+    sitemapQueue.clear();
+    seenSitemaps.clear();
+    batch.clear();
+    urlCount = 0;
+    sitemapCount = 0;
+    running = true;
+
+    const QString path = url.path().toLower();
+    if (path.endsWith(".xml") || path.endsWith(".xml.gz") || path.contains("sitemap"))
+        explicitSitemap = url;
+
+    // robots.txt first: it lists the sitemaps and says which paths we may not take
+    QUrl robots = url;
+    robots.setPath("/robots.txt");
+    robots.setQuery(QString());
+    robots.setFragment(QString());
+
+    emit progress("Reading " + robots.toString());
+    reply = net->get(QNetworkRequest(robots));
+    connect(reply, &QNetworkReply::finished, this, &SitemapCrawler::onRobotsFinished);
+}
+
+void SitemapCrawler::abort()
+{
+    if (reply) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+        reply = nullptr;
+    }
+    running = false;
+}
+
+// -------------------- robots.txt --------------------
+void SitemapCrawler::onRobotsFinished()
+{
+    QNetworkReply* r = reply;
+    reply = nullptr;
+    r->deleteLater();
+
+    // a missing robots.txt just means no rules and no declared sitemaps
+    if (r->error() == QNetworkReply::NoError)
+        parseRobots(r->readAll());
+
+    if (explicitSitemap.isValid()) {
+        sitemapQueue.clear();
+        enqueueSitemap(explicitSitemap);
+    } else if (sitemapQueue.isEmpty()) {
+        QUrl fallback = site;
+        fallback.setPath("/sitemap.xml");
+        fallback.setQuery(QString());
+        enqueueSitemap(fallback);
+    }
+
+    fetchNextSitemap();
+}
+
+void SitemapCrawler::parseRobots(const QByteArray& text)
+{
+    bool groupForUs = false;
+    bool inAgentLines = false;
+
+    for (QByteArray line : text.split('\n')) {
+        const int hash = line.indexOf('#');
+        if (hash >= 0) line.truncate(hash);
+        line = line.trimmed();
+
+        const int colon = line.indexOf(':');
+        if (colon <= 0) continue;
+
+        const QByteArray key = line.left(colon).trimmed().toLower();
+        const QString value = QString::fromUtf8(line.mid(colon + 1).trimmed());
+
+        if (key == "sitemap") {
+            enqueueSitemap(site.resolved(QUrl(value)));
+            continue;
+        }
+
+        if (key == "user-agent") {
+            // consecutive User-agent lines share one group
+            if (!inAgentLines) groupForUs = false;
+            inAgentLines = true;
+            if (value == "*") groupForUs = true;
+            continue;
+        }
+        inAgentLines = false;
+
+        if (!groupForUs || (key != "allow" && key != "disallow") || value.isEmpty())
+            continue;
+
+        // robots patterns: '*' matches anything, a trailing '$' anchors the end
+        QString re = QRegularExpression::escape(value);
+        re.replace("\\*", ".*");
+        if (re.endsWith("\\$")) {
+            re.chop(2);
+            re += "$";
+        }
+
+        RobotsRule rule;
+        rule.pattern = QRegularExpression("^" + re);
+        rule.length = value.size();
+        rule.allow = key == "allow";
+        rules.push_back(rule);
+    }
+}
+
+bool SitemapCrawler::allowedByRobots(const QUrl& u) const
+{
+    // the longest matching rule wins; Allow wins ties
+    const QString path = u.path(QUrl::FullyEncoded) + (u.hasQuery() ? "?" + u.query(QUrl::FullyEncoded) : QString());
+    int bestLength = -1;
+    bool allowed = true;
+    for (const RobotsRule& r : rules) {
+        if (r.length < bestLength) continue;
+        if (!r.pattern.match(path).hasMatch()) continue;
+        if (r.length > bestLength || r.allow) {
+            bestLength = r.length;
+            allowed = r.allow;
+        }
+    }
+    return allowed;
+}
+
+// -------------------- Sitemaps --------------------
+void SitemapCrawler::enqueueSitemap(const QUrl& u)
+{
+    if (!u.isValid() || (u.scheme() != "http" && u.scheme() != "https")) return;
+
+    const QString key = u.toString();
+    if (seenSitemaps.contains(key) || seenSitemaps.size() >= maxSitemaps) return;
+
+    seenSitemaps.insert(key);
+    sitemapQueue.enqueue(u);
+}
+
+void SitemapCrawler::fetchNextSitemap()
+{
+    if (!running) return;
+
+    if (sitemapQueue.isEmpty() || urlCount >= maxUrls) {
+        finish(QString());
+        return;
+    }
+
+    const QUrl u = sitemapQueue.dequeue();
+    sitemapCount++;
+
+    xml.clear();
+    gunzip.reset();
+    sniffed = false;
+    block = Block::None;
+    field = Field::None;
+
+    emit progress(QString("Reading sitemap %1 (%2 URLs so far)").arg(u.toString()).arg(urlCount));
+
+    reply = net->get(QNetworkRequest(u));
+    connect(reply, &QNetworkReply::readyRead, this, &SitemapCrawler::onSitemapData);
+    connect(reply, &QNetworkReply::finished, this, &SitemapCrawler::onSitemapFinished);
+}
+
+void SitemapCrawler::onSitemapData()
+{
+    if (reply && !consume(reply))
+        reply->abort();
+}
+
+void SitemapCrawler::onSitemapFinished()
+{
+    QNetworkReply* r = reply;
+    if (!r) return;
+    reply = nullptr;
+
+    if (r->error() == QNetworkReply::NoError)
+        consume(r);
+    else if (r->error() != QNetworkReply::OperationCanceledError)
+        emit progress("Sitemap " + r->url().toString() + ": " + r->errorString());
+
+    r->deleteLater();
+
+    flushBatch();
+    fetchNextSitemap();
+}
+
+bool SitemapCrawler::consume(QNetworkReply* r)
+{
+    if (r->error() != QNetworkReply::NoError) return true;
+
+    QByteArray chunk = r->readAll();
+    if (chunk.isEmpty()) return true;
+
+    // .xml.gz files arrive as raw gzip (unlike Content-Encoding, which Qt already undoes)
+    if (!sniffed) {
+        sniffed = true;
+        if (GzipStream::looksCompressed(chunk))
+            gunzip.reset(new GzipStream());
+    }
+
+    if (gunzip) {
+        QByteArray plain;
+        if (!gunzip->feed(chunk, &plain)) {
+            emit progress("Sitemap " + r->url().toString() + ": " + gunzip->errorString());
+            return false;
+        }
+        chunk.swap(plain);
+    }
+
+    xml.addData(chunk);
+    return parseAvailable();
+}
+
+bool SitemapCrawler::parseAvailable()
+{
+    while (!xml.atEnd()) {
+        const QXmlStreamReader::TokenType t = xml.readNext();
+
+        if (xml.hasError()) {
+            // ran out of bytes mid-document: resume on the next chunk
+            if (xml.error() == QXmlStreamReader::PrematureEndOfDocumentError)
+                return true;
+            emit progress("Sitemap XML error: " + xml.errorString());
+            return false;
+        }
+
+        if (t == QXmlStreamReader::StartElement) {
+            const auto name = xml.name();
+            if (name == QLatin1String("url")) {
+                block = Block::Url;
+                loc.clear();
+                lastmod.clear();
+            } else if (name == QLatin1String("sitemap")) {
+                block = Block::Sitemap;
+                loc.clear();
+                lastmod.clear();
+            } else if (name == QLatin1String("loc")) {
+                field = Field::Loc;
+            } else if (name == QLatin1String("lastmod")) {
+                field = Field::LastMod;
+            }
+        } else if (t == QXmlStreamReader::Characters) {
+            if (field == Field::Loc) loc += xml.text();
+            else if (field == Field::LastMod) lastmod += xml.text();
+        } else if (t == QXmlStreamReader::EndElement) {
+            const auto name = xml.name();
+            if (name == QLatin1String("loc") || name == QLatin1String("lastmod")) {
+                field = Field::None;
+            } else if (name == QLatin1String("sitemap") && block == Block::Sitemap) {
+                block = Block::None;
+                enqueueSitemap(QUrl(loc.trimmed()));
+            } else if (name == QLatin1String("url") && block == Block::Url) {
+                block = Block::None;
+
+                SitemapEntry e;
+                e.url = QUrl(loc.trimmed());
+                e.lastModified = QDateTime::fromString(lastmod.trimmed(), Qt::ISODate);
+                if (!e.url.isValid() || !allowedByRobots(e.url))
+                    continue;
+
+                batch.push_back(e);
+                if (++urlCount >= maxUrls) {
+                    flushBatch();
+                    return false;
+                }
+                if (batch.size() >= batchSize)
+                    flushBatch();
+            }
+        }
+    }
+    return true;
+}
+
+void SitemapCrawler::flushBatch()
+{
+    if (batch.isEmpty()) return;
+    emit urlsFound(batch);
+    batch.clear();
+}
+
+void SitemapCrawler::finish(const QString& error)
+{
+    flushBatch();
+    running = false;
+    emit finished(urlCount, sitemapCount, error);
+}
@@ -0,0 +1,92 @@
+#ifndef SITEMAPCRAWLER_H
+#define SITEMAPCRAWLER_H
+
+
+#include <QObject>
+#include <QDateTime>
+#include <QList>
+#include <QQueue>
+#include <QRegularExpression>
+#include <QSet>
+#include <QUrl>
+#include <QXmlStreamReader>
+#include <memory>
+
+#include "gzipstream.h"
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+struct SitemapEntry {
+    QUrl url;
+    QDateTime lastModified;   // invalid when the sitemap has no <lastmod>
+};
+
+// Discovers file URLs of a site from robots.txt and its sitemaps. Sitemap index
+// files are followed, .gz sitemaps are inflated on the fly, and every document is
+// parsed while it downloads, so memory use does not depend on sitemap size.
+class SitemapCrawler : public QObject {
+    Q_OBJECT
+public:
+    explicit SitemapCrawler(QNetworkAccessManager* net, QObject* parent = nullptr);
+    ~SitemapCrawler() override;
+
+    // url: a site, its robots.txt, or a sitemap (then only that sitemap tree is read)
+    void start(const QUrl& url);
+    void abort();
+    bool isRunning() const { return running; }
+
+    int maxSitemaps = 1000;
+    qint64 maxUrls = 20000;
+    int batchSize = 500;
+
+signals:
+    void urlsFound(QList<SitemapEntry> entries);
+    void progress(QString message);
+    void finished(qint64 urls, int sitemaps, QString error);
+
+private:
+    struct RobotsRule {
+        QRegularExpression pattern;
+        int length = 0;
+        bool allow = false;
+    };
+
+    void onRobotsFinished();
+    void parseRobots(const QByteArray& text);
+    bool allowedByRobots(const QUrl& u) const;
+
+    void enqueueSitemap(const QUrl& u);
+    void fetchNextSitemap();
+    void onSitemapData();
+    void onSitemapFinished();
+    bool consume(QNetworkReply* r);
+    bool parseAvailable();
+    void flushBatch();
+    void finish(const QString& error);
+
+    QNetworkAccessManager* net;
+    QNetworkReply* reply = nullptr;
+    QUrl site;
+    QUrl explicitSitemap;
+    bool running = false;
+
+    QList<RobotsRule> rules;
+    QQueue<QUrl> sitemapQueue;
+    QSet<QString> seenSitemaps;
+
+    // per-document streaming state
+    QXmlStreamReader xml;
+    std::unique_ptr<GzipStream> gunzip;
+    bool sniffed = false;
+    enum class Block { None, Url, Sitemap } block = Block::None;
+    enum class Field { None, Loc, LastMod } field = Field::None;
+    QString loc;
+    QString lastmod;
+
+    QList<SitemapEntry> batch;
+    qint64 urlCount = 0;
+    int sitemapCount = 0;
+};
+
+#endif
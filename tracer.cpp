@@ -0,0 +1,187 @@
+#include "tracer.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QCoreApplication>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char* cat;
+    const char* name;
+    char phase;        // 'X' complete, 'b'/'e' async, 'i' instant
+    qint64 tsUs;
+    qint64 durUs;
+    qint64 id;
+};
+
+const quint64 RING_SIZE = 1 << 16;   // events kept per thread (oldest are overwritten)
+
+struct ThreadBuffer {
+    std::unique_ptr<Event[]> events{ new Event[RING_SIZE] };
+    std::atomic<quint64> head{0};    // total events ever written by the owning thread
+    std::atomic<quint64> exportFrom{0};   // events before this index were cleared
+    int tid = 0;
+    QByteArray threadName;
+};
+
+QMutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;   // buffers outlive their threads
+thread_local ThreadBuffer* localBuffer = nullptr;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+ThreadBuffer* buffer()
+{
+    if (localBuffer) return localBuffer;
+
+    // once per thread, so the lock never shows up on the hot path
+    auto buf = std::make_unique<ThreadBuffer>();
+    QMutexLocker lock(&registryMutex);
+    buf->tid = int(registry.size()) + 1;
+
+    QCoreApplication* app = QCoreApplication::instance();
+    if (app && QThread::currentThread() == app->thread())
+        buf->threadName = "main";
+    else if (!QThread::currentThread()->objectName().isEmpty())
+        buf->threadName = QThread::currentThread()->objectName().toUtf8();
+    else
+        buf->threadName = "thread-" + QByteArray::number(buf->tid);
+
+    localBuffer = buf.get();
+    registry.push_back(std::move(buf));
+    return localBuffer;
+}
+
+void record(char phase, const char* cat, const char* name, qint64 ts, qint64 dur, qint64 id)
+{
+    ThreadBuffer* b = buffer();
+    const quint64 h = b->head.load(std::memory_order_relaxed);
+    b->events[h % RING_SIZE] = Event{ cat, name, phase, ts, dur, id };
+    b->head.store(h + 1, std::memory_order_release);
+}
+
+QByteArray jsonString(const char* s)
+{
+    QByteArray out = "\"";
+    for (const char* p = s; *p; ++p) {
+        if (*p == '"' || *p == '\\') out += '\\';
+        out += *p;
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+namespace Trace {
+
+std::atomic<bool> enabledFlag{false};
+
+void setEnabled(bool on)
+{
+    enabledFlag.store(on, std::memory_order_relaxed);
+}
+
+qint64 nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - epoch).count();
+}
+
+void complete(const char* cat, const char* name, qint64 startUs, qint64 durUs, qint64 id)
+{
+    if (!enabled()) return;
+    record('X', cat, name, startUs, durUs, id);
+}
+
+void asyncBegin(const char* cat, const char* name, qint64 id)
+{
+    if (!enabled()) return;
+    record('b', cat, name, nowUs(), 0, id);
+}
+
+void asyncEnd(const char* cat, const char* name, qint64 id)
+{
+    if (!enabled()) return;
+    record('e', cat, name, nowUs(), 0, id);
+}
+
+void instant(const char* cat, const char* name, qint64 id)
+{
+    if (!enabled()) return;
+    record('i', cat, name, nowUs(), 0, id);
+}
+
+bool writeChromeJson(const QString& path, QString* error)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = f.errorString();
+        return false;
+    }
+
+    QTextStream out(&f);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto sep = [&]() { out << (first ? "" : ",\n"); first = false; };
+
+    const qint64 pid = QCoreApplication::applicationPid();
+
+    QMutexLocker lock(&registryMutex);
+    for (const auto& b : registry) {
+        sep();
+        out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << b->tid
+            << ",\"args\":{\"name\":" << jsonString(b->threadName.constData()) << "}}";
+
+        // copy the live window, then drop anything the owner may have overwritten meanwhile
+        const quint64 head = b->head.load(std::memory_order_acquire);
+        const quint64 begin = qMax(head > RING_SIZE ? head - RING_SIZE : 0,
+                                   qMin(head, b->exportFrom.load(std::memory_order_relaxed)));
+        std::vector<Event> copy;
+        copy.reserve(size_t(head - begin));
+        for (quint64 i = begin; i < head; ++i)
+            copy.push_back(b->events[i % RING_SIZE]);
+
+        const quint64 after = b->head.load(std::memory_order_acquire);
+        // index `after` may be mid-write, and its slot is the one of after - RING_SIZE
+        const quint64 safeFrom = after + 1 > RING_SIZE ? after + 1 - RING_SIZE : 0;
+
+        for (quint64 i = begin; i < head; ++i) {
+            if (i < safeFrom) continue;
+            const Event& e = copy[size_t(i - begin)];
+
+            sep();
+            out << "{\"ph\":\"" << e.phase << "\",\"cat\":" << jsonString(e.cat)
+                << ",\"name\":" << jsonString(e.name)
+                << ",\"pid\":" << pid << ",\"tid\":" << b->tid << ",\"ts\":" << e.tsUs;
+            if (e.phase == 'X')
+                out << ",\"dur\":" << e.durUs;
+            if (e.phase == 'b' || e.phase == 'e')
+                out << ",\"id\":" << e.id;
+            if (e.phase == 'i')
+                out << ",\"s\":\"t\"";
+            if (e.id >= 0)
+                out << ",\"args\":{\"job\":" << e.id << "}";
+            out << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    out.flush();
+    return f.error() == QFile::NoError;
+}
+
+void clear()
+{
+    QMutexLocker lock(&registryMutex);
+    for (const auto& b : registry)
+        b->exportFrom.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+} // namespace Trace
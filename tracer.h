@@ -0,0 +1,56 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+
+#include <QString>
+#include <atomic>
+
+// Opt-in lifecycle tracing. Every thread records into its own fixed-size ring
+// buffer (single writer, no locks on the hot path); export merges them into Chrome
+// trace JSON that Perfetto / chrome://tracing open directly. While disabled each
+// probe costs one relaxed atomic load. Names and categories must be string literals.
+namespace Trace {
+
+extern std::atomic<bool> enabledFlag;
+
+inline bool enabled() { return enabledFlag.load(std::memory_order_relaxed); }
+void setEnabled(bool on);
+
+qint64 nowUs();
+
+// id < 0: not tied to a job
+void complete(const char* cat, const char* name, qint64 startUs, qint64 durUs, qint64 id = -1);
+void asyncBegin(const char* cat, const char* name, qint64 id);
+void asyncEnd(const char* cat, const char* name, qint64 id);
+void instant(const char* cat, const char* name, qint64 id = -1);
+
+bool writeChromeJson(const QString& path, QString* error = nullptr);
+void clear();
+
+} // namespace Trace
+
+class TraceSpan {
+public:
+    TraceSpan(const char* cat, const char* name, qint64 id = -1)
+        : cat(cat), name(name), id(id), startUs(Trace::enabled() ? Trace::nowUs() : -1) {}
+    ~TraceSpan()
+    {
+        if (startUs >= 0)
+            Trace::complete(cat, name, startUs, Trace::nowUs() - startUs, id);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* cat;
+    const char* name;
+    qint64 id;
+    qint64 startUs;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(cat, name, id) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(cat, name, id)
+
+#endif
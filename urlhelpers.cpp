@@ -0,0 +1,47 @@
+#include "urlhelpers.h"
+
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSet>
+
+namespace UrlHelpers {
+
+QString fileNameFromUrl(const QString& urlStr)
+{
+    QUrl url(urlStr);
+    QString name = QFileInfo(url.path()).fileName();
+    if (name.isEmpty()) name = "download.bin";
+    return name;
+}
+
+QList<QUrl> extractLinksFromHtml(const QString& html, const QUrl& baseUrl)
+{
+    QList<QUrl> out;
+    QSet<QString> seen;
+
+    QRegularExpression re(
+        R"((?:href|src)\s*=\s*["']([^"'#]+)["'])",
+        QRegularExpression::CaseInsensitiveOption
+        );
+
+    auto it = re.globalMatch(html);
+    while (it.hasNext()) {
+        auto m = it.next();
+        const QString raw = m.captured(1).trimmed();
+        if (raw.isEmpty()) continue;
+
+        QUrl resolved = baseUrl.resolved(QUrl(raw));
+        if (!resolved.isValid()) continue;
+
+        if (resolved.scheme() != "http" && resolved.scheme() != "https") continue;
+
+        const QString key = resolved.toString(QUrl::FullyDecoded);
+        if (seen.contains(key)) continue;
+        seen.insert(key);
+
+        out.push_back(resolved);
+    }
+    return out;
+}
+
+} // namespace UrlHelpers
@@ -0,0 +1,21 @@
+#ifndef URLHELPERS_H
+#define URLHELPERS_H
+
+
+#include <QList>
+#include <QString>
+#include <QUrl>
+
+// Pure helpers on URLs and fetched pages, kept free of MainWindow state so the
+// benchmarks in bench/ can drive them directly.
+namespace UrlHelpers {
+
+// Last path segment, "download.bin" when the URL has none.
+QString fileNameFromUrl(const QString& urlStr);
+
+// http(s) href/src targets resolved against baseUrl, first occurrence of each only.
+QList<QUrl> extractLinksFromHtml(const QString& html, const QUrl& baseUrl);
+
+} // namespace UrlHelpers
+
+#endif